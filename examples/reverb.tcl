@@ -7,8 +7,9 @@ set sig [car [cdr [sndread "../sounds/anechoic1.wav"]]]
 set irL [car [cdr [sndread "../sounds/Concertgebouw-s.wav"]]]
 set irR [car [cdr [cdr [sndread "../sounds/Concertgebouw-s.wav"]]]]
 
-set outsigL [conv $irL $sig $scale $mix]
-set outsigR [conv $irR $sig $scale $mix]
+set outsig [multiconv [list $irL $irR] $sig $scale $mix]
+# cheaper draft, linear in the length of the signal:
+# set outsig [fdn $sig 44100 2.2 $scale $mix]
 
-sndwrite 44100 "reverb.wav" $outsigL $outsigR
+sndwrite 44100 "reverb.wav" [car $outsig] [second $outsig]
 
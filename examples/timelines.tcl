@@ -9,14 +9,16 @@ set tab2 [gen 4096 1]
 set amps [list [bpf 0 [/ $samps 3] 0.3 [/ $samps 3] 0.3 [/ $samps 3] 0] [bpf 0 [/ $samps 2] 0.3 [/ $samps 2] 0] [bpf 0 [/ $samps 2] 0.3 [/ $samps 2] 0]]
 set freqs [list [bpf 220 $samps 550] [bpf 110 $samps 220] [bpf 440 $samps 220]]
 
-set env [bpf 0 [/ $samps 2] 0.5 [/ $samps 2] 0]
+# voices are rendered when their event starts, with their own duration
+proc glide {dur f0 f1} {* [bpf 0 [/ $dur 2] 0.5 [/ $dur 2] 0] [osc $sr [bpf $f0 $dur $f1] $tab1]}
+proc bank {dur} {oscbank $sr $amps $freqs $tab2}
 
-set s1 0 #[* $env [osc $sr [bpf 220 $samps 330] $tab1]]
-set s2 0 #[* $env [osc $sr [bpf 220 $samps 1660] $tab1]]
-set s3 [oscbank $sr $amps $freqs $tab2]
-set s4 0 #[* $env [osc $sr [bpf 110 $samps 60] $tab1]]
-
-set timeline1 [mix 0 $s1 [/ $samps 2] $s2 [* 3 [/ $samps 4]] $s3 0 $s4]]
+set timeline1 [score]
+#event $timeline1 0 $samps glide 220 330
+#event $timeline1 [/ $samps 2] $samps glide 220 1660
+event $timeline1 [* 3 [/ $samps 4]] $samps bank
+#event $timeline1 0 $samps glide 110 60
+set timeline1 [render $timeline1]
 
 set irL [car [cdr [sndread "../sounds/Concertgebouw-s.wav"]]]
 set irR [car [cdr [cdr [sndread "../sounds/Concertgebouw-s.wav"]]]]
@@ -24,7 +26,6 @@ set irR [car [cdr [cdr [sndread "../sounds/Concertgebouw-s.wav"]]]]
 set scale 0.01
 set mix 0.4
 
-set outsigL [conv $irL $timeline1 $scale $mix]
-set outsigR [conv $irR $timeline1 $scale $mix]
+set outsig [multiconv [list $irL $irR] $timeline1 $scale $mix]
 
-sndwrite $sr "timelines.wav" $outsigL $outsigR
+sndwrite $sr "timelines.wav" [car $outsig] [second $outsig]
@@ -1,11 +1,13 @@
 // BPF.h
-// 
+//
 
 #ifndef BPF_H
-#define BPF_H 
+#define BPF_H
 
 #include <valarray>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 template <typename T>
 class Processor {
@@ -15,67 +17,102 @@ public:
 	virtual void process (std::valarray<T>& out) = 0;
 	virtual int len () const { return _len; }
 protected:
-	T _len;
+	int _len;
 };
+//! Segment from init to end in len samples (end excluded)
+/*!
+  With curve = 0 the segment is a line; otherwise the value at i is
+  init + (end - init) (1 - exp (curve i / len)) / (1 - exp (curve)): positive
+  curves start slowly and end fast, negative ones the opposite (a decay of
+  an amplitude envelope sounds linear with curve around -4).
+*/
 template <typename T>
 class Segment : public Processor<T> {
 public:
-	Segment (T init, int len, T end) : Processor <T> (len) {
-		set (init, len, end);
+	Segment (T init, int len, T end, T curve = 0) : Processor <T> (len) {
+		set (init, len, end, curve);
 	}
-	void set (T init_val, int len, T end_val) {
+	void set (T init_val, int len, T end_val, T curve = 0) {
 		_init_val = init_val;
-		Processor<T>::_len = len;
+		Processor<T>::_len = len < 0 ? 0 : len;
 		_end_val = end_val;
+		_curve = fabs (curve) < 1e-3 ? 0 : curve;
+	}
+	T init () const { return _init_val; }
+	T end () const { return _end_val; }
+	//! samples [from, from + n) of the segment
+	void render (T* out, int from, int n) const {
+		int s = Processor<T>::_len;
+		T range = _end_val - _init_val;
+		if (_curve == 0) {
+			T incr = range / s;
+			for (int i = 0; i < n; ++i) out[i] = _init_val + (from + i) * incr;
+		} else {
+			T scale = range / (1 - exp (_curve));
+			T step = exp (_curve / s);
+			T e = exp (_curve * from / s);
+			for (int i = 0; i < n; ++i) {
+				out[i] = _init_val + scale * (1 - e);
+				e *= step;
+			}
+		}
 	}
 	void process (std::valarray<T>& out) {
 		int s = Processor<T>::len ();
-		if (out.size () < s) out.resize (s);
-		T val = _init_val;
-		T incr = (_end_val - _init_val) / s;
-		for (int i = 0; i < s; ++i) {
-			out[i] = val;
-			val += incr;
-		}
+		if ((int) out.size () < s) out.resize (s);
+		if (s) render (&out[0], 0, s);
 	}
 private:
-	T _init_val, _end_val;
+	T _init_val, _end_val, _curve;
 };
+//! Sequence of segments, rendered at once or block by block
+/*!
+  Segments are stored by value and write directly into the output. render
+  gives any range of samples, so an envelope can be read block by block
+  without being built; after the last segment its final value is held.
+*/
 template <typename T>
 class BPF : public Processor<T> {
 public:
-	BPF (int len) : Processor <T> (len) {}
-	~BPF () {
-		for (unsigned i = 0; i < _segments.size (); ++i) delete _segments[i];
-	}
-	void add_segment (T init_val, int len, T end_val) {
-		Segment<T>* s = new Segment<T> (init_val, len, end_val);
-		_segments.push_back (s);
-	}
-	int len () const {
-		int s = 0;
-		for (unsigned i = 0; i < _segments.size (); ++i) {
-			s += _segments[i]->len ();
-		}
-		return s;
+	BPF () : Processor <T> (0) { _total = 0; }
+	void add_segment (T init_val, int len, T end_val, T curve = 0) {
+		_segments.push_back (Segment<T> (init_val, len, end_val, curve));
+		_offsets.push_back (_total);
+		_total += _segments.back ().len ();
 	}
+	int len () const { return (int) _total; }
+	int segments () const { return (int) _segments.size (); }
 	void process (std::valarray<T>& out) {
 		int s = len ();
-		if (out.size () < s) out.resize (s);
-		int offset = 0;
-		for (unsigned i = 0; i < _segments.size (); ++i) {
-			std::valarray<T> tmp;
-			_segments[i]->process (tmp);
-			for (unsigned k = 0; k < tmp.size (); ++k) {
-				out[k + offset] = tmp[k];
+		if ((int) out.size () < s) out.resize (s);
+		if (s) render (&out[0], 0, s);
+	}
+	//! samples [from, from + n)
+	void render (T* out, long from, int n) const {
+		// first segment ending after from
+		unsigned k = std::upper_bound (_offsets.begin (), _offsets.end (), from) - _offsets.begin ();
+		k = k ? k - 1 : 0;
+		int i = 0;
+		while (i < n && k < _segments.size ()) {
+			const Segment<T>& s = _segments[k];
+			long pos = from + i - _offsets[k];
+			if (pos >= s.len ()) {
+				++k;
+				continue;
 			}
-			offset += _segments[i]->len ();
+			int count = (int) (s.len () - pos < n - i ? s.len () - pos : n - i);
+			s.render (out + i, (int) pos, count);
+			i += count;
 		}
+		T last = _segments.empty () ? 0 : _segments.back ().end ();
+		for (; i < n; ++i) out[i] = last;
 	}
 private:
-	std::vector<Segment<T>* > _segments;
+	std::vector<Segment<T> > _segments;
+	std::vector<long> _offsets;
+	long _total;
 };
 
-#endif	// BPF_H 
+#endif	// BPF_H
 
 // EOF
@@ -18,9 +18,13 @@
 	#include <vecLib/vDSP.h>
 #endif
 
+#include "ThreadPool.h"
+#include "SIMD.h"
+
 #include <stdexcept>
 #include <algorithm>
 #include <vector>
+#include <cstring>
 #include <cmath>
 
 //! Peak representation
@@ -159,9 +163,14 @@ public:
 };
 
 //! Base class for the all FFTs
+/*!
+  Data is interleaved complex; forward uses exp (-i), inverse is the
+  unnormalized inverse transform (divide by N to get the input back).
+*/
 template<typename T>
 class AbstractFFT {
 public:
+	virtual ~AbstractFFT () {}
 	virtual void forward (T*) = 0;
 	virtual void inverse (T*) = 0;
 };
@@ -250,7 +259,7 @@ public:
 		conjugate (data);
 		scramble (data);
 		recursion.apply (data);
-
+		conjugate (data);
 #endif
 	}
 private:
@@ -272,8 +281,419 @@ private:
 #endif
 };
 
+//! One radix-4 (or final radix-2) pass of the Stockham autosort algorithm
+template <typename T>
+struct SimdStage {
+	int n; // length of the sub-transforms
+	int s; // stride
+	std::vector<T> w; // w1r w1i w2r w2i w3r w3i, n / 4 values each
+};
+
+template <typename T, int W>
+SIMD_INLINE void simd_radix4_pass (const SimdStage<T>& st, const T* xr, const T* xi, T* yr, T* yi) {
+	typedef typename SimdVec<T, W>::type V;
+	const int s = st.s;
+	const int m = st.n / 4;
+	const T* w1r = &st.w[0]; const T* w1i = w1r + m;
+	const T* w2r = w1i + m; const T* w2i = w2r + m;
+	const T* w3r = w2i + m; const T* w3i = w3r + m;
+	if (s >= W) { // lanes over the stride, twiddles broadcast
+		for (int p = 0; p < m; ++p) {
+			V c1r, c1i; simd_set1 (c1r, w1r[p]); simd_set1 (c1i, w1i[p]);
+			V c2r, c2i; simd_set1 (c2r, w2r[p]); simd_set1 (c2i, w2i[p]);
+			V c3r, c3i; simd_set1 (c3r, w3r[p]); simd_set1 (c3i, w3i[p]);
+			const T* ar = xr + s * p; const T* ai = xi + s * p;
+			T* o = yr + s * 4 * p; T* oi = yi + s * 4 * p;
+			for (int q = 0; q < s; q += W) {
+				V a0r, a0i; simd_load (a0r, ar + q); simd_load (a0i, ai + q);
+				V a1r, a1i; simd_load (a1r, ar + q + s * m); simd_load (a1i, ai + q + s * m);
+				V a2r, a2i; simd_load (a2r, ar + q + 2 * s * m); simd_load (a2i, ai + q + 2 * s * m);
+				V a3r, a3i; simd_load (a3r, ar + q + 3 * s * m); simd_load (a3i, ai + q + 3 * s * m);
+				V t0r = a0r + a2r, t0i = a0i + a2i;
+				V t1r = a0r - a2r, t1i = a0i - a2i;
+				V t2r = a1r + a3r, t2i = a1i + a3i;
+				V t3r = a1i - a3i, t3i = a3r - a1r; // -i (a1 - a3)
+				V u1r = t1r + t3r, u1i = t1i + t3i;
+				V u2r = t0r - t2r, u2i = t0i - t2i;
+				V u3r = t1r - t3r, u3i = t1i - t3i;
+				simd_store (o + q, t0r + t2r); simd_store (oi + q, t0i + t2i);
+				simd_store (o + q + s, u1r * c1r - u1i * c1i); simd_store (oi + q + s, u1r * c1i + u1i * c1r);
+				simd_store (o + q + 2 * s, u2r * c2r - u2i * c2i); simd_store (oi + q + 2 * s, u2r * c2i + u2i * c2r);
+				simd_store (o + q + 3 * s, u3r * c3r - u3i * c3i); simd_store (oi + q + 3 * s, u3r * c3i + u3i * c3r);
+			}
+		}
+	} else if (s == 1 && m >= W) { // first pass: lanes over the butterflies
+		for (int p = 0; p < m; p += W) {
+			V a0r, a0i; simd_load (a0r, xr + p); simd_load (a0i, xi + p);
+			V a1r, a1i; simd_load (a1r, xr + p + m); simd_load (a1i, xi + p + m);
+			V a2r, a2i; simd_load (a2r, xr + p + 2 * m); simd_load (a2i, xi + p + 2 * m);
+			V a3r, a3i; simd_load (a3r, xr + p + 3 * m); simd_load (a3i, xi + p + 3 * m);
+			V c1r, c1i; simd_load (c1r, w1r + p); simd_load (c1i, w1i + p);
+			V c2r, c2i; simd_load (c2r, w2r + p); simd_load (c2i, w2i + p);
+			V c3r, c3i; simd_load (c3r, w3r + p); simd_load (c3i, w3i + p);
+			V t0r = a0r + a2r, t0i = a0i + a2i;
+			V t1r = a0r - a2r, t1i = a0i - a2i;
+			V t2r = a1r + a3r, t2i = a1i + a3i;
+			V t3r = a1i - a3i, t3i = a3r - a1r;
+			V u1r = t1r + t3r, u1i = t1i + t3i;
+			V u2r = t0r - t2r, u2i = t0i - t2i;
+			V u3r = t1r - t3r, u3i = t1i - t3i;
+			V y0r = t0r + t2r, y0i = t0i + t2i;
+			V y1r = u1r * c1r - u1i * c1i, y1i = u1r * c1i + u1i * c1r;
+			V y2r = u2r * c2r - u2i * c2i, y2i = u2r * c2i + u2i * c2r;
+			V y3r = u3r * c3r - u3i * c3i, y3i = u3r * c3i + u3i * c3r;
+			for (int l = 0; l < W; ++l) {
+				T* o = yr + 4 * (p + l); T* oi = yi + 4 * (p + l);
+				o[0] = y0r[l]; o[1] = y1r[l]; o[2] = y2r[l]; o[3] = y3r[l];
+				oi[0] = y0i[l]; oi[1] = y1i[l]; oi[2] = y2i[l]; oi[3] = y3i[l];
+			}
+		}
+	} else {
+		for (int p = 0; p < m; ++p) {
+			for (int q = 0; q < s; ++q) {
+				const T* ar = xr + q + s * p; const T* ai = xi + q + s * p;
+				T t0r = ar[0] + ar[2 * s * m], t0i = ai[0] + ai[2 * s * m];
+				T t1r = ar[0] - ar[2 * s * m], t1i = ai[0] - ai[2 * s * m];
+				T t2r = ar[s * m] + ar[3 * s * m], t2i = ai[s * m] + ai[3 * s * m];
+				T t3r = ai[s * m] - ai[3 * s * m], t3i = ar[3 * s * m] - ar[s * m];
+				T u1r = t1r + t3r, u1i = t1i + t3i;
+				T u2r = t0r - t2r, u2i = t0i - t2i;
+				T u3r = t1r - t3r, u3i = t1i - t3i;
+				T* o = yr + q + s * 4 * p; T* oi = yi + q + s * 4 * p;
+				o[0] = t0r + t2r; oi[0] = t0i + t2i;
+				o[s] = u1r * w1r[p] - u1i * w1i[p]; oi[s] = u1r * w1i[p] + u1i * w1r[p];
+				o[2 * s] = u2r * w2r[p] - u2i * w2i[p]; oi[2 * s] = u2r * w2i[p] + u2i * w2r[p];
+				o[3 * s] = u3r * w3r[p] - u3i * w3i[p]; oi[3 * s] = u3r * w3i[p] + u3i * w3r[p];
+			}
+		}
+	}
+}
+
+template <typename T, int W>
+SIMD_INLINE void simd_radix2_pass (const SimdStage<T>& st, const T* xr, const T* xi, T* yr, T* yi) {
+	typedef typename SimdVec<T, W>::type V;
+	const int s = st.s;
+	int q = 0;
+	for (; q + W <= s; q += W) {
+		V ar, ai; simd_load (ar, xr + q); simd_load (ai, xi + q);
+		V br, bi; simd_load (br, xr + q + s); simd_load (bi, xi + q + s);
+		simd_store (yr + q, ar + br); simd_store (yi + q, ai + bi);
+		simd_store (yr + q + s, ar - br); simd_store (yi + q + s, ai - bi);
+	}
+	for (; q < s; ++q) {
+		T ar = xr[q], ai = xi[q], br = xr[q + s], bi = xi[q + s];
+		yr[q] = ar + br; yi[q] = ai + bi;
+		yr[q + s] = ar - br; yi[q + s] = ai - bi;
+	}
+}
+
+// runs all the passes ping-ponging between x and y; returns true if the result is in y
+template <typename T, int W>
+SIMD_INLINE bool simd_fft_passes (const std::vector<SimdStage<T> >& stages, T* xr, T* xi, T* yr, T* yi) {
+	bool swapped = false;
+	for (unsigned i = 0; i < stages.size (); ++i) {
+		if (stages[i].n == 2) simd_radix2_pass<T, W> (stages[i], xr, xi, yr, yi);
+		else simd_radix4_pass<T, W> (stages[i], xr, xi, yr, yi);
+		std::swap (xr, yr);
+		std::swap (xi, yi);
+		swapped = !swapped;
+	}
+	return swapped;
+}
+
+template <typename T>
+bool simd_fft_default (const std::vector<SimdStage<T> >& stages, T* xr, T* xi, T* yr, T* yi) {
+	return simd_fft_passes<T, 16 / sizeof (T)> (stages, xr, xi, yr, yi);
+}
+
+#if defined (SIMD_X86)
+template <typename T>
+SIMD_TARGET_AVX2 bool simd_fft_avx2 (const std::vector<SimdStage<T> >& stages, T* xr, T* xi, T* yr, T* yi) {
+	return simd_fft_passes<T, 32 / sizeof (T)> (stages, xr, xi, yr, yi);
+}
+#endif
+
+//! Vectorized radix-4 Stockham FFT on a split real/imag layout
+/*!
+  Stockham passes need no bit-reversal and keep unit stride in the inner loop,
+  so each pass is a straight SIMD sweep (AVX2 when the CPU has it, SSE2/NEON
+  otherwise). forward/inverse convert from and to the interleaved layout of
+  AbstractFFT; forward_split/inverse_split work directly on split data. The
+  inverse uses the swap trick IDFT (x) = swap (DFT (swap (x))).
+*/
+template <typename T>
+class SimdFFT : public AbstractFFT<T> {
+private:
+	SimdFFT& operator= (SimdFFT&);
+	SimdFFT (const SimdFFT&);
+public:
+	SimdFFT (int N) {
+		int P = 0;
+		while ((1 << P) < N) ++P;
+		if ((1 << P) != N || P < 2) throw std::runtime_error ("invalid size requested for fft");
+		m_N = N;
+		m_avx2 = simd_has_avx2 ();
+		for (int n = N, s = 1; n > 1; s *= 4, n /= 4) {
+			SimdStage<T> st;
+			st.n = n;
+			st.s = s;
+			if (n > 2) {
+				int m = n / 4;
+				st.w.resize (6 * m);
+				for (int p = 0; p < m; ++p) {
+					for (int k = 1; k <= 3; ++k) {
+						st.w[(2 * k - 2) * m + p] = cos (TWOPI * k * p / n);
+						st.w[(2 * k - 1) * m + p] = -sin (TWOPI * k * p / n);
+					}
+				}
+			}
+			m_stages.push_back (st);
+			if (n == 2) break;
+		}
+		m_re.resize (N); m_im.resize (N);
+		m_wre.resize (N); m_wim.resize (N);
+	}
+	void forward (T* data) {
+		split (data, &m_re[0], &m_im[0]);
+		T* r = &m_re[0]; T* i = &m_im[0];
+		if (passes (&m_re[0], &m_im[0], &m_wre[0], &m_wim[0])) { r = &m_wre[0]; i = &m_wim[0]; }
+		merge (r, i, data);
+	}
+	void inverse (T* data) {
+		split (data, &m_im[0], &m_re[0]);
+		T* r = &m_re[0]; T* i = &m_im[0];
+		if (passes (&m_re[0], &m_im[0], &m_wre[0], &m_wim[0])) { r = &m_wre[0]; i = &m_wim[0]; }
+		merge (i, r, data);
+	}
+	void forward_split (T* re, T* im) {
+		if (passes (re, im, &m_wre[0], &m_wim[0])) {
+			memcpy (re, &m_wre[0], m_N * sizeof (T));
+			memcpy (im, &m_wim[0], m_N * sizeof (T));
+		}
+	}
+	void inverse_split (T* re, T* im) {
+		forward_split (im, re);
+	}
+	int size () const { return m_N; }
+private:
+	bool passes (T* xr, T* xi, T* yr, T* yi) {
+#if defined (SIMD_X86)
+		if (m_avx2) return simd_fft_avx2<T> (m_stages, xr, xi, yr, yi);
+#endif
+		return simd_fft_default<T> (m_stages, xr, xi, yr, yi);
+	}
+	void split (const T* data, T* re, T* im) {
+		for (int i = 0; i < m_N; ++i) {
+			re[i] = data[2 * i];
+			im[i] = data[2 * i + 1];
+		}
+	}
+	void merge (const T* re, const T* im, T* data) {
+		for (int i = 0; i < m_N; ++i) {
+			data[2 * i] = re[i];
+			data[2 * i + 1] = im[i];
+		}
+	}
+	std::vector<SimdStage<T> > m_stages;
+	std::vector<T> m_re, m_im, m_wre, m_wim;
+	int m_N;
+	bool m_avx2;
+};
+
+//! Available FFT engines (see createFFT)
+enum FFTType {FFT_AUTO, FFT_TEMPLATE, FFT_SIMD, FFT_FOURSTEP};
+
+//! Sizes from which FFT_AUTO switches to the four-step engine (with and without threads)
+const int FOURSTEP_THRESHOLD = 1 << 16;
+const int FOURSTEP_SERIAL_THRESHOLD = 1 << 22;
+
 template <typename T>
-	AbstractFFT<T>* createFFT (int N) {
+	AbstractFFT<T>* createFFT (int N, FFTType type = FFT_AUTO);
+
+//! Cache-friendly FFT for large sizes (four-step algorithm)
+/*!
+  The N = N1 * N2 points are seen as a N1 x N2 matrix x[n1][n2]: first the N2
+  columns are transformed (gathered in small contiguous batches) and multiplied
+  by the twiddles, then the N1 rows are transformed in place and the matrix is
+  transposed to natural order. Every sub-FFT works on contiguous data that fits
+  in cache, and no bit-reversal ever touches the whole buffer. Batches and rows
+  are spread over the thread pool; each chunk of work owns its sub-FFTs and
+  buffers, so engines with internal state can be used for the sub-transforms.
+*/
+template <typename T>
+class FourStepFFT : public AbstractFFT<T> {
+private:
+	FourStepFFT& operator= (FourStepFFT&);
+	FourStepFFT (const FourStepFFT&);
+	enum { BATCH = 16 }; // columns gathered at once and transpose tile
+public:
+	FourStepFFT (int N, ThreadPool& pool = ThreadPool::instance ()) : m_pool (pool) {
+		int P = 0;
+		while ((1 << P) < N) ++P;
+		if ((1 << P) != N || P < 4) throw std::runtime_error ("invalid size requested for fft");
+		m_N = N;
+		m_N1 = 1 << (P / 2);
+		m_N2 = N / m_N1;
+		m_shift = P / 2;
+		if (m_N1 != m_N2) m_scratch.resize (2 * (size_t) N);
+
+		// W_N^t = coarse[t >> shift] * fine[t & mask]
+		int nfine = 1 << m_shift;
+		int ncoarse = N >> m_shift;
+		m_fine.resize (2 * nfine);
+		m_coarse.resize (2 * ncoarse);
+		for (int i = 0; i < nfine; ++i) {
+			m_fine[2 * i] = cos (TWOPI * i / N);
+			m_fine[2 * i + 1] = -sin (TWOPI * i / N);
+		}
+		for (int i = 0; i < ncoarse; ++i) {
+			m_coarse[2 * i] = cos (TWOPI * ((double) i * nfine) / N);
+			m_coarse[2 * i + 1] = -sin (TWOPI * ((double) i * nfine) / N);
+		}
+
+		m_batch = m_N2 < BATCH ? m_N2 : BATCH;
+		m_chunks = 4 * m_pool.size ();
+		if (m_chunks > m_N2 / m_batch) m_chunks = m_N2 / m_batch;
+		for (int i = 0; i < m_chunks; ++i) {
+			m_cols.push_back (createFFT<T> (m_N1, FFT_SIMD));
+			m_rows.push_back (createFFT<T> (m_N2, FFT_SIMD));
+			m_batches.push_back (std::vector<T> (2 * m_batch * m_N1));
+		}
+	}
+	virtual ~FourStepFFT () {
+		for (unsigned i = 0; i < m_cols.size (); ++i) {
+			delete m_cols[i];
+			delete m_rows[i];
+		}
+	}
+	void forward (T* data) {
+		// columns: x[n1][n2] -> X1[k1][n2] * W_N^(n2 k1)
+		int batches = m_N2 / m_batch;
+		m_pool.parallel_for (0, m_chunks, [&] (int c) {
+			T* buf = &m_batches[c][0];
+			int first = (int) ((long) batches * c / m_chunks);
+			int last = (int) ((long) batches * (c + 1) / m_chunks);
+			for (int b = first; b < last; ++b) {
+				int col = b * m_batch;
+				for (int n1 = 0; n1 < m_N1; ++n1) {
+					const T* src = data + 2 * ((size_t) n1 * m_N2 + col);
+					for (int j = 0; j < m_batch; ++j) {
+						buf[2 * (j * m_N1 + n1)] = src[2 * j];
+						buf[2 * (j * m_N1 + n1) + 1] = src[2 * j + 1];
+					}
+				}
+				for (int j = 0; j < m_batch; ++j) {
+					m_cols[c]->forward (buf + 2 * j * m_N1);
+					twiddle (buf + 2 * j * m_N1, col + j);
+				}
+				for (int k1 = 0; k1 < m_N1; ++k1) {
+					T* dst = data + 2 * ((size_t) k1 * m_N2 + col);
+					for (int j = 0; j < m_batch; ++j) {
+						dst[2 * j] = buf[2 * (j * m_N1 + k1)];
+						dst[2 * j + 1] = buf[2 * (j * m_N1 + k1) + 1];
+					}
+				}
+			}
+		});
+		// rows: X1[k1][n2] -> X[k1][k2]
+		m_pool.parallel_for (0, m_chunks, [&] (int c) {
+			int first = (int) ((long) m_N1 * c / m_chunks);
+			int last = (int) ((long) m_N1 * (c + 1) / m_chunks);
+			for (int k1 = first; k1 < last; ++k1) {
+				m_rows[c]->forward (data + 2 * (size_t) k1 * m_N2);
+			}
+		});
+		// natural order k1 + N1 * k2
+		if (m_N1 == m_N2) transpose (data);
+		else {
+			transpose (data, &m_scratch[0], m_N1, m_N2);
+			memcpy (data, &m_scratch[0], 2 * (size_t) m_N * sizeof (T));
+		}
+	}
+	void inverse (T* data) {
+		conjugate (data);
+		forward (data);
+		conjugate (data);
+	}
+	int size () const { return m_N; }
+private:
+	void conjugate (T* data) {
+		for (int i = 0; i < m_N; ++i) data[2 * i + 1] = -data[2 * i + 1];
+	}
+	void twiddle (T* col, int n2) {
+		int mask = (1 << m_shift) - 1;
+		for (int k1 = 1; k1 < m_N1; ++k1) {
+			long t = (long) n2 * k1;
+			const T* c = &m_coarse[2 * (t >> m_shift)];
+			const T* f = &m_fine[2 * (t & mask)];
+			T wr = c[0] * f[0] - c[1] * f[1];
+			T wi = c[0] * f[1] + c[1] * f[0];
+			T re = col[2 * k1];
+			T im = col[2 * k1 + 1];
+			col[2 * k1] = re * wr - im * wi;
+			col[2 * k1 + 1] = re * wi + im * wr;
+		}
+	}
+	// out of place, blocked
+	void transpose (const T* src, T* dst, int rows, int cols) {
+		int tiles = (rows + BATCH - 1) / BATCH;
+		m_pool.parallel_for (0, tiles, [&] (int tr) {
+			int r0 = tr * BATCH;
+			int r1 = r0 + BATCH < rows ? r0 + BATCH : rows;
+			for (int c0 = 0; c0 < cols; c0 += BATCH) {
+				int c1 = c0 + BATCH < cols ? c0 + BATCH : cols;
+				for (int r = r0; r < r1; ++r) {
+					for (int c = c0; c < c1; ++c) {
+						dst[2 * ((size_t) c * rows + r)] = src[2 * ((size_t) r * cols + c)];
+						dst[2 * ((size_t) c * rows + r) + 1] = src[2 * ((size_t) r * cols + c) + 1];
+					}
+				}
+			}
+		});
+	}
+	// in place for square matrices, tiles above the diagonal swapped with the ones below
+	void transpose (T* data) {
+		int n = m_N1;
+		int tiles = (n + BATCH - 1) / BATCH;
+		m_pool.parallel_for (0, tiles, [&] (int tr) {
+			int r0 = tr * BATCH;
+			int r1 = r0 + BATCH < n ? r0 + BATCH : n;
+			for (int c0 = r0; c0 < n; c0 += BATCH) {
+				int c1 = c0 + BATCH < n ? c0 + BATCH : n;
+				for (int r = r0; r < r1; ++r) {
+					for (int c = (c0 == r0 ? r + 1 : c0); c < c1; ++c) {
+						std::swap (data[2 * ((size_t) r * n + c)], data[2 * ((size_t) c * n + r)]);
+						std::swap (data[2 * ((size_t) r * n + c) + 1], data[2 * ((size_t) c * n + r) + 1]);
+					}
+				}
+			}
+		});
+	}
+	ThreadPool& m_pool;
+	int m_N;
+	int m_N1;
+	int m_N2;
+	int m_shift;
+	int m_batch;
+	int m_chunks;
+	std::vector<T> m_scratch;
+	std::vector<T> m_fine;
+	std::vector<T> m_coarse;
+	std::vector<AbstractFFT<T>*> m_cols;
+	std::vector<AbstractFFT<T>*> m_rows;
+	std::vector<std::vector<T> > m_batches;
+};
+
+//! Factory for the FFT engines; FFT_AUTO picks the fastest one for the size
+template <typename T>
+	AbstractFFT<T>* createFFT (int N, FFTType type) {
+		if (type == FFT_AUTO) {
+			int threshold = ThreadPool::instance ().size () > 1 ? 
+				FOURSTEP_THRESHOLD : FOURSTEP_SERIAL_THRESHOLD;
+			type = N >= threshold ? FFT_FOURSTEP : FFT_SIMD;
+		}
+		if (type == FFT_FOURSTEP && N >= 16) return new FourStepFFT<T> (N);
+		if (type == FFT_SIMD && N >= 4) return new SimdFFT<T> (N);
 		switch (N) {
 		case 4:
 			return new FFT<2, T> ();
@@ -349,6 +769,81 @@ template <typename T>
 		}
 }
 
+//! FFT of real signals through a complex FFT of half the size
+/*!
+  The N real samples are packed as N / 2 complex values (even samples in the
+  real part, odd samples in the imaginary part) and the two halves of the
+  spectrum are separated afterwards. The spectrum has N / 2 + 1 interleaved
+  bins (N + 2 values, DC and Nyquist included); as for AbstractFFT the inverse
+  is unnormalized, so divide by N to get the input back.
+*/
+template <typename T>
+class RealFFT {
+private:
+	RealFFT& operator= (RealFFT&);
+	RealFFT (const RealFFT&);
+public:
+	RealFFT (int N) {
+		if (N < 8 || (N & (N - 1))) throw std::runtime_error ("invalid size requested for real fft");
+		m_N = N;
+		m_M = N / 2;
+		m_fft = createFFT<T> (m_M);
+		m_buff.resize (2 * m_M);
+		m_cos.resize (m_M);
+		m_sin.resize (m_M);
+		for (int k = 0; k < m_M; ++k) {
+			m_cos[k] = cos (TWOPI * k / N);
+			m_sin[k] = -sin (TWOPI * k / N);
+		}
+	}
+	virtual ~RealFFT () {
+		delete m_fft;
+	}
+	int size () const { return m_N; }
+	int bins () const { return m_M + 1; }
+	void forward (const T* in, T* spectrum) {
+		T* z = &m_buff[0];
+		memcpy (z, in, m_N * sizeof (T));
+		m_fft->forward (z);
+		spectrum[0] = z[0] + z[1];
+		spectrum[1] = 0;
+		spectrum[2 * m_M] = z[0] - z[1];
+		spectrum[2 * m_M + 1] = 0;
+		for (int k = 1; k < m_M; ++k) {
+			T zr = z[2 * k], zi = z[2 * k + 1];
+			T cr = z[2 * (m_M - k)], ci = -z[2 * (m_M - k) + 1];
+			// even part (z + conj z') / 2, odd part (z - conj z') / 2i
+			T er = (zr + cr) * .5, ei = (zi + ci) * .5;
+			T or_ = (zi - ci) * .5, oi = -(zr - cr) * .5;
+			spectrum[2 * k] = er + m_cos[k] * or_ - m_sin[k] * oi;
+			spectrum[2 * k + 1] = ei + m_cos[k] * oi + m_sin[k] * or_;
+		}
+	}
+	void inverse (const T* spectrum, T* out) {
+		T* z = &m_buff[0];
+		for (int k = 0; k < m_M; ++k) {
+			T xr = spectrum[2 * k], xi = spectrum[2 * k + 1];
+			T cr = spectrum[2 * (m_M - k)], ci = -spectrum[2 * (m_M - k) + 1];
+			T er = xr + cr, ei = xi + ci;
+			T dr = xr - cr, di = xi - ci;
+			// odd part: (x - conj x') * conj (w^k)
+			T or_ = dr * m_cos[k] + di * m_sin[k];
+			T oi = di * m_cos[k] - dr * m_sin[k];
+			z[2 * k] = er - oi;
+			z[2 * k + 1] = ei + or_;
+		}
+		m_fft->inverse (z);
+		memcpy (out, z, m_N * sizeof (T));
+	}
+private:
+	int m_N;
+	int m_M;
+	AbstractFFT<T>* m_fft;
+	std::vector<T> m_buff;
+	std::vector<T> m_cos;
+	std::vector<T> m_sin;
+};
+
 template <typename T>
 void fft (T *fftBuffer, long fftFrameSize, long sign) {
 	T wr, wi, arg, *p1, *p2, temp;
@@ -558,6 +1053,19 @@ inline void ampFreqPhaseDiff (const T* cbuffer, T* amp, T* freq, T* oldPhi,
 	}
 }
 
+//! Vertex of the parabola through three points: returns x, stores y in peak
+template <typename T>
+T parabolicInterpolate (T x1, T x2, T x3, T y1, T y2, T y3, T* peak) {
+	T den = y1 - 2 * y2 + y3;
+	if (den == 0) {
+		*peak = y2;
+		return x2;
+	}
+	T p = .5 * (y1 - y3) / den; // offset in [-.5, .5] for a local maximum
+	*peak = y2 - .25 * (y1 - y3) * p;
+	return x2 + p * (x3 - x2);
+}
+
 template <typename T>
 void ampFreqParabolic (const T* cbuffer, T* amp, T* freq, int N,  double R) {
 	T freqPerBin = (R ) / (T) N;
@@ -584,19 +1092,12 @@ void ampFreqBins (const T* cbuffer, T* amp, T* freq, int N,  double R) {
 		freq[i] = (T) i * freqPerBin;
 	}
 }
+//! Strongest n of the k peaks, sorted by decreasing amplitude (O (k log n))
 template<typename T>
-void sortSpectrum (Peak<T>* peaks, int k) {
-	Peak<T> p;
-	for (int i = 0; i < k; ++i) {
-		for (int j = i + 1; j < k; ++j) {
-			//if (peaks[i].freq > peaks[j].freq) {
-			if (peaks[i].amp < peaks[j].amp) {
-				p = peaks[i];
-				peaks[i] = peaks[j];
-				peaks[j] = p;
-			}
-		}	
-	}	
+void sortSpectrum (Peak<T>* peaks, int k, int n = -1) {
+	if (n < 0 || n > k) n = k;
+	std::partial_sort (peaks, peaks + n, peaks + k,
+		[] (const Peak<T>& a, const Peak<T>& b) { return a.amp > b.amp; });
 }
 
 #endif	// FFT_H 
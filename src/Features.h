@@ -0,0 +1,236 @@
+// Features.h
+//
+
+#ifndef FEATURES_H
+#define FEATURES_H
+
+#include "FFT.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cmath>
+
+//! Descriptors computed by FeatureExtractor (MFCC takes MFCC_COEFFS columns)
+enum FeatureType {FEAT_RMS, FEAT_CENTROID, FEAT_SPREAD, FEAT_FLUX, FEAT_ROLLOFF,
+	FEAT_FLATNESS, FEAT_ZCR, FEAT_MFCC, FEAT_COUNT};
+const int MFCC_COEFFS = 13;
+const int MEL_BANDS = 40;
+
+//! One-pass extraction of per-frame descriptors
+/*!
+  Frames of N samples are centred every hop samples and the output is a
+  frame-major matrix with one column per selected descriptor, in the order
+  given. The magnitude spectrum of each frame is computed once and shared by
+  all the spectral descriptors. Frames are split in contiguous chunks over the
+  thread pool; each chunk also analyses the frame before its first one, so
+  that the flux does not depend on the split.
+*/
+template <typename T>
+class FeatureExtractor {
+private:
+	FeatureExtractor& operator= (FeatureExtractor&);
+	FeatureExtractor (const FeatureExtractor&);
+public:
+	FeatureExtractor (int N, int hop, T sr, const std::vector<int>& features) {
+		if (N < 8 || (N & (N - 1))) throw std::runtime_error ("invalid size requested for features");
+		m_N = N;
+		m_bins = N / 2 + 1;
+		m_hop = hop < 1 ? 1 : hop;
+		m_sr = sr;
+		m_features = features;
+		m_columns = 0;
+		for (unsigned i = 0; i < features.size (); ++i) {
+			m_columns += features[i] == FEAT_MFCC ? MFCC_COEFFS : 1;
+		}
+		m_window.resize (N);
+		hanningz (&m_window[0], N);
+		T sum = 0;
+		for (int i = 0; i < N; ++i) sum += m_window[i];
+		m_norm = 2. / sum;
+		melFilters ();
+	}
+	virtual ~FeatureExtractor () {}
+	int columns () const { return m_columns; }
+	long frames (long len) const { return (len + m_hop - 1) / m_hop; }
+	void process (const T* in, long len, std::vector<T>& out) {
+		long count = frames (len);
+		out.assign (count * m_columns, 0);
+		ThreadPool& pool = ThreadPool::instance ();
+		int chunks = pool.size () * 4;
+		if (chunks > count) chunks = (int) count;
+		pool.parallel_for (0, chunks, [&] (int c) {
+			RealFFT<T> fft (m_N);
+			std::vector<T> frame (m_N + 2);
+			std::vector<T> spectrum (m_N + 2);
+			std::vector<T> mag (m_bins);
+			std::vector<T> prev (m_bins);
+			long first = count * c / chunks;
+			if (first > 0) magnitudes (fft, in, len, first - 1, frame, spectrum, prev);
+			for (long f = first; f < count * (c + 1) / chunks; ++f) {
+				magnitudes (fft, in, len, f, frame, spectrum, mag);
+				descriptors (&in[0], len, f, mag, prev, f > 0, &out[f * m_columns]);
+				mag.swap (prev);
+			}
+		});
+	}
+private:
+	void magnitudes (RealFFT<T>& fft, const T* in, long len, long f,
+		std::vector<T>& frame, std::vector<T>& spectrum, std::vector<T>& mag) const {
+		long start = f * m_hop - m_N / 2;
+		for (int i = 0; i < m_N; ++i) {
+			long t = start + i;
+			frame[i] = t >= 0 && t < len ? in[t] * m_window[i] : 0;
+		}
+		fft.forward (&frame[0], &spectrum[0]);
+		for (int k = 0; k < m_bins; ++k) {
+			T re = spectrum[2 * k], im = spectrum[2 * k + 1];
+			mag[k] = sqrt (re * re + im * im) * m_norm;
+		}
+	}
+	void descriptors (const T* in, long len, long f, const std::vector<T>& mag,
+		const std::vector<T>& prev, bool hasPrev, T* row) const {
+		T binHz = m_sr / m_N;
+		T sumMag = 0, sumPow = 0, sumFreq = 0;
+		for (int k = 0; k < m_bins; ++k) {
+			sumMag += mag[k];
+			sumPow += mag[k] * mag[k];
+			sumFreq += k * binHz * mag[k];
+		}
+		T centroid = sumMag > 0 ? sumFreq / sumMag : 0;
+		int col = 0;
+		for (unsigned i = 0; i < m_features.size (); ++i) {
+			switch (m_features[i]) {
+			case FEAT_RMS: {
+				// time domain, on the unwindowed frame
+				long start = f * m_hop - m_N / 2;
+				T s = 0;
+				for (int j = 0; j < m_N; ++j) {
+					long t = start + j;
+					if (t >= 0 && t < len) s += in[t] * in[t];
+				}
+				row[col++] = sqrt (s / m_N);
+			}
+			break;
+			case FEAT_CENTROID:
+				row[col++] = centroid;
+			break;
+			case FEAT_SPREAD: {
+				T s = 0;
+				for (int k = 0; k < m_bins; ++k) {
+					T d = k * binHz - centroid;
+					s += d * d * mag[k];
+				}
+				row[col++] = sumMag > 0 ? sqrt (s / sumMag) : 0;
+			}
+			break;
+			case FEAT_FLUX: {
+				T s = 0;
+				if (hasPrev) {
+					for (int k = 0; k < m_bins; ++k) {
+						T d = mag[k] - prev[k];
+						s += d * d;
+					}
+				}
+				row[col++] = sqrt (s);
+			}
+			break;
+			case FEAT_ROLLOFF: {
+				T limit = .85 * sumPow;
+				T s = 0;
+				int k = 0;
+				for (; k < m_bins - 1; ++k) {
+					s += mag[k] * mag[k];
+					if (s >= limit) break;
+				}
+				row[col++] = sumPow > 0 ? k * binHz : 0;
+			}
+			break;
+			case FEAT_FLATNESS: {
+				// geometric over arithmetic mean of the power spectrum
+				T logs = 0;
+				for (int k = 0; k < m_bins; ++k) logs += log (mag[k] * mag[k] + 1e-20);
+				T mean = sumPow / m_bins;
+				row[col++] = mean > 0 ? exp (logs / m_bins) / (mean + 1e-20) : 0;
+			}
+			break;
+			case FEAT_ZCR: {
+				long start = f * m_hop - m_N / 2;
+				int crossings = 0;
+				for (int j = 1; j < m_N; ++j) {
+					long t = start + j;
+					if (t - 1 < 0 || t >= len) continue;
+					if ((in[t - 1] >= 0) != (in[t] >= 0)) ++crossings;
+				}
+				row[col++] = (T) crossings / (m_N - 1);
+			}
+			break;
+			case FEAT_MFCC: {
+				T bands[MEL_BANDS];
+				for (int b = 0; b < MEL_BANDS; ++b) {
+					T e = 0;
+					for (int k = m_melStart[b]; k < m_melEnd[b]; ++k) {
+						e += m_melWeights[b][k - m_melStart[b]] * mag[k] * mag[k];
+					}
+					bands[b] = log (e + 1e-10);
+				}
+				for (int c = 0; c < MFCC_COEFFS; ++c) {
+					T s = 0;
+					for (int b = 0; b < MEL_BANDS; ++b) s += m_dct[c * MEL_BANDS + b] * bands[b];
+					row[col++] = s;
+				}
+			}
+			break;
+			}
+		}
+	}
+	static T hz2mel (T f) { return 2595. * log10 (1. + f / 700.); }
+	static T mel2hz (T m) { return 700. * (pow (10., m / 2595.) - 1.); }
+	void melFilters () {
+		// triangular filters evenly spaced on the mel scale up to Nyquist
+		T binHz = m_sr / m_N;
+		T top = hz2mel (m_sr / 2);
+		std::vector<T> edges (MEL_BANDS + 2);
+		for (int i = 0; i < MEL_BANDS + 2; ++i) edges[i] = mel2hz (top * i / (MEL_BANDS + 1));
+		m_melStart.resize (MEL_BANDS);
+		m_melEnd.resize (MEL_BANDS);
+		m_melWeights.resize (MEL_BANDS);
+		for (int b = 0; b < MEL_BANDS; ++b) {
+			T lo = edges[b], mid = edges[b + 1], hi = edges[b + 2];
+			int start = (int) ceil (lo / binHz);
+			int end = (int) floor (hi / binHz) + 1;
+			if (end > m_bins) end = m_bins;
+			if (start >= end) start = end - 1;
+			m_melStart[b] = start;
+			m_melEnd[b] = end;
+			for (int k = start; k < end; ++k) {
+				T f = k * binHz;
+				T w = f <= mid ? (f - lo) / (mid - lo) : (hi - f) / (hi - mid);
+				m_melWeights[b].push_back (w < 0 ? 0 : w);
+			}
+		}
+		// orthonormal DCT-II
+		m_dct.resize (MFCC_COEFFS * MEL_BANDS);
+		for (int c = 0; c < MFCC_COEFFS; ++c) {
+			T scale = c == 0 ? sqrt (1. / MEL_BANDS) : sqrt (2. / MEL_BANDS);
+			for (int b = 0; b < MEL_BANDS; ++b) {
+				m_dct[c * MEL_BANDS + b] = scale * cos (PI * c * (b + .5) / MEL_BANDS);
+			}
+		}
+	}
+	int m_N;
+	int m_bins;
+	int m_hop;
+	T m_sr;
+	T m_norm;
+	int m_columns;
+	std::vector<int> m_features;
+	std::vector<T> m_window;
+	std::vector<int> m_melStart;
+	std::vector<int> m_melEnd;
+	std::vector<std::vector<T> > m_melWeights;
+	std::vector<T> m_dct;
+};
+
+#endif	// FEATURES_H
+
+// EOF
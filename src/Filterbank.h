@@ -0,0 +1,169 @@
+// Filterbank.h
+//
+
+#ifndef FILTERBANK_H
+#define FILTERBANK_H
+
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cmath>
+
+//! Coefficients of a second-order section
+/*!
+  y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+*/
+template <typename T>
+struct Biquad {
+	T b0, b1, b2, a1, a2;
+	//! two-pole resonator with the coefficients of reson, scaled by amp
+	static Biquad resonator (T sr, T freq, T tau, T amp) {
+		Biquad c;
+		T om = 2 * M_PI * (freq / sr);
+		T radius = exp (-2. * M_PI * (1. / tau) / sr);
+		c.b0 = c.b2 = 0;
+		c.b1 = amp * radius * sin (om);
+		c.a1 = -2 * radius * cos (om);
+		c.a2 = radius * radius;
+		return c;
+	}
+};
+
+//! W second-order sections on the same input, their outputs added to out
+/*!
+  Transposed direct form II, one section per lane; coeffs holds b0, b1, b2,
+  a1, a2 (W values each), state s1 and s2 (W values each).
+*/
+template <typename T, int W>
+SIMD_CLONES void biquad_lanes (const T* in, T* out, int n, const T* coeffs, T* state) {
+	typedef typename SimdVec<T, W>::type V;
+	V b0, b1, b2, a1, a2, s1, s2, y;
+	V x = {};
+	simd_load (b0, coeffs);
+	simd_load (b1, coeffs + W);
+	simd_load (b2, coeffs + 2 * W);
+	simd_load (a1, coeffs + 3 * W);
+	simd_load (a2, coeffs + 4 * W);
+	simd_load (s1, state);
+	simd_load (s2, state + W);
+	for (int i = 0; i < n; ++i) {
+		simd_set1 (x, in[i]);
+		y = b0 * x + s1;
+		s1 = b1 * x - a1 * y + s2;
+		s2 = b2 * x - a2 * y;
+		T sum = y[0];
+		for (int k = 1; k < W; ++k) sum += y[k];
+		out[i] += sum;
+	}
+	simd_store (state, s1);
+	simd_store (state + W, s2);
+}
+
+//! Parameters of a resonator: one value, or one value per sample
+template <typename T>
+struct ResonatorTrack {
+	const T* freqs;
+	int nfreqs;
+	const T* taus;
+	int ntaus;
+	const T* amps;
+	int namps;
+};
+
+//! Bank of resonators on one input, summed
+/*!
+  The sections are packed LANES at a time in SIMD vectors (unused lanes have
+  zero coefficients), so one pass over the input runs LANES filters. The
+  output is rendered in blocks of BLOCK samples; in every block groups of
+  sections are spread over the thread pool, each job adding into its own
+  buffer, and the buffers are summed in a fixed order, so the result does
+  not depend on the number of threads. Parameters given per sample are read
+  at control rate, every CONTROL samples, where the coefficients of the
+  section are recomputed. Denormals are flushed to zero while rendering.
+*/
+template <typename T>
+class ResonatorBank {
+private:
+	ResonatorBank& operator= (ResonatorBank&);
+	ResonatorBank (const ResonatorBank&);
+	static const int LANES = 4;
+	static const int GROUPS = 4; // groups of lanes per job
+	static const int BLOCK = 4096;
+	static const int CONTROL = 32;
+public:
+	ResonatorBank (T sr, const std::vector<ResonatorTrack<T> >& tracks) {
+		m_sr = sr;
+		m_tracks = tracks;
+		m_groups = ((int) tracks.size () + LANES - 1) / LANES;
+		m_coeffs.assign (m_groups * 5 * LANES, 0);
+		m_state.assign (m_groups * 2 * LANES, 0);
+		m_varying = false;
+		for (unsigned k = 0; k < tracks.size (); ++k) {
+			if (tracks[k].nfreqs > 1 || tracks[k].ntaus > 1 || tracks[k].namps > 1) m_varying = true;
+			update (k, 0);
+		}
+	}
+	virtual ~ResonatorBank () {}
+	int filters () const { return (int) m_tracks.size (); }
+	//! len samples of output from the first inlen samples of in
+	void process (const T* in, long inlen, T* out, long len, bool threaded) {
+		int jobs = (m_groups + GROUPS - 1) / GROUPS;
+		std::vector<T> input (BLOCK);
+		std::vector<T> partial (jobs * BLOCK);
+		ThreadPool& pool = ThreadPool::instance ();
+		for (long t = 0; t < len; t += BLOCK) {
+			int n = (int) (len - t < BLOCK ? len - t : BLOCK);
+			for (int i = 0; i < n; ++i) input[i] = t + i < inlen ? in[t + i] : 0;
+			std::fill (partial.begin (), partial.end (), 0);
+			auto job = [&] (int j) {
+				DenormalGuard guard;
+				int last = (j + 1) * GROUPS < m_groups ? (j + 1) * GROUPS : m_groups;
+				for (int g = j * GROUPS; g < last; ++g) group (g, t, &input[0], &partial[j * BLOCK], n);
+			};
+			if (threaded && jobs > 1) pool.parallel_for (0, jobs, job);
+			else for (int j = 0; j < jobs; ++j) job (j);
+			for (int j = 0; j < jobs; ++j) {
+				const T* p = &partial[j * BLOCK];
+				for (int i = 0; i < n; ++i) out[t + i] += p[i];
+			}
+		}
+	}
+private:
+	void group (int g, long t, const T* in, T* out, int n) {
+		T* coeffs = &m_coeffs[g * 5 * LANES];
+		T* state = &m_state[g * 2 * LANES];
+		if (!m_varying) {
+			biquad_lanes<T, LANES> (in, out, n, coeffs, state);
+			return;
+		}
+		for (int i = 0; i < n; i += CONTROL) {
+			for (int k = g * LANES; k < (g + 1) * LANES && k < filters (); ++k) update (k, t + i);
+			biquad_lanes<T, LANES> (in + i, out + i, n - i < CONTROL ? n - i : CONTROL, coeffs, state);
+		}
+	}
+	static T value (const T* v, int count, long t) {
+		return v[t < count ? t : count - 1];
+	}
+	void update (int k, long t) {
+		const ResonatorTrack<T>& tr = m_tracks[k];
+		Biquad<T> c = Biquad<T>::resonator (m_sr, value (tr.freqs, tr.nfreqs, t),
+			value (tr.taus, tr.ntaus, t), value (tr.amps, tr.namps, t));
+		T* coeffs = &m_coeffs[(k / LANES) * 5 * LANES + k % LANES];
+		coeffs[0] = c.b0;
+		coeffs[LANES] = c.b1;
+		coeffs[2 * LANES] = c.b2;
+		coeffs[3 * LANES] = c.a1;
+		coeffs[4 * LANES] = c.a2;
+	}
+	T m_sr;
+	std::vector<ResonatorTrack<T> > m_tracks;
+	int m_groups;
+	bool m_varying;
+	std::vector<T> m_coeffs;
+	std::vector<T> m_state;
+};
+
+#endif	// FILTERBANK_H
+
+// EOF
@@ -0,0 +1,175 @@
+// Granular.h
+//
+
+#ifndef GRANULAR_H
+#define GRANULAR_H
+
+#include "FFT.h"
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+//! Parameters of a grain (times in samples)
+template <typename T>
+struct Grain {
+	long onset;
+	long duration;
+	double position; //!< in the source
+	T pitch; //!< reading speed
+	T amp;
+	T pan; //!< 0 left, 1 right
+};
+
+//! Sample j of a grain, reading outside the source as 0
+template <typename T>
+SIMD_INLINE T grain_sample (const T* src, long len, const T* window, double p, T w) {
+	long ip = (long) floor (p);
+	T frac = (T) (p - ip);
+	T lo = ip >= 0 && ip < len ? src[ip] : 0;
+	T hi = ip + 1 >= 0 && ip + 1 < len ? src[ip + 1] : 0;
+	int iw = (int) w;
+	return (lo + frac * (hi - lo)) * (window[iw] + (w - iw) * (window[iw + 1] - window[iw]));
+}
+
+//! Samples [j, j + n) of a grain added to left (and right), W at a time
+/*!
+  Source and window positions are kept in vectors and advanced by W steps;
+  the lookups are gathered lane by lane, the interpolations and the products
+  run on the whole vector. Vectors whose reads fall (partly) outside the
+  source take the checked scalar path.
+*/
+template <typename T, int W>
+SIMD_CLONES void grain_segment (const T* src, long len, const T* window, double pos, T pitch,
+	T wincr, long j, int n, T gl, T gr, T* left, T* right) {
+	typedef typename SimdVec<T, W>::type V;
+	typedef typename SimdVec<long, W>::type VL;
+	V p, w, dp, dw, l, r;
+	V slo = {}, shi = {}, wlo = {}, whi = {}, s = {};
+	for (int k = 0; k < W; ++k) {
+		p[k] = pos + (double) (j + k) * pitch;
+		w[k] = (j + k) * wincr;
+	}
+	simd_set1 (dp, (T) (W * pitch));
+	simd_set1 (dw, (T) (W * wincr));
+	int i = 0;
+	for (; i + W <= n; i += W) {
+		if (p[0] >= 0 && p[W - 1] >= 0 && p[0] < len - 1 && p[W - 1] < len - 1) {
+			VL ip = __builtin_convertvector (p, VL);
+			VL iw = __builtin_convertvector (w, VL);
+			V sfrac = p - __builtin_convertvector (ip, V);
+			V wfrac = w - __builtin_convertvector (iw, V);
+			for (int k = 0; k < W; ++k) {
+				slo[k] = src[ip[k]];
+				shi[k] = src[ip[k] + 1];
+				wlo[k] = window[iw[k]];
+				whi[k] = window[iw[k] + 1];
+			}
+			s = (slo + sfrac * (shi - slo)) * (wlo + wfrac * (whi - wlo));
+		} else {
+			for (int k = 0; k < W; ++k) s[k] = grain_sample (src, len, window, (double) p[k], w[k]);
+		}
+		simd_load (l, left + i);
+		l += s * gl;
+		simd_store (left + i, l);
+		if (right) {
+			simd_load (r, right + i);
+			r += s * gr;
+			simd_store (right + i, r);
+		}
+		p += dp;
+		w += dw;
+	}
+	for (; i < n; ++i) {
+		T v = grain_sample (src, len, window, pos + (double) (j + i) * pitch, (j + i) * wincr);
+		left[i] += v * gl;
+		if (right) right[i] += v * gr;
+	}
+}
+
+//! Renders clouds of grains from a source
+/*!
+  Grains are sorted by onset; the output is cut in blocks of BLOCK samples
+  and each block only visits the grains that overlap it (found by binary
+  search among the grains starting less than the longest duration before
+  the block), adding them in onset order. Blocks are independent, so they
+  are spread over the thread pool and the result does not depend on the
+  number of threads. Grains use a Hann window of WINDOW points; panning is
+  equal power.
+*/
+template <typename T>
+class GranularEngine {
+private:
+	GranularEngine& operator= (GranularEngine&);
+	GranularEngine (const GranularEngine&);
+	static const int LANES = 4;
+	static const int BLOCK = 4096;
+	static const int WINDOW = 4096;
+public:
+	GranularEngine (const T* source, long len) {
+		m_source = source;
+		m_len = len;
+		m_window.resize (WINDOW + 2);
+		for (int i = 0; i <= WINDOW; ++i) m_window[i] = .5 - .5 * cos (TWOPI * i / WINDOW);
+		m_window[WINDOW + 1] = 0;
+	}
+	virtual ~GranularEngine () {}
+	//! sorts the grains; right is left empty for mono output
+	void process (std::vector<Grain<T> >& grains, bool stereo, bool threaded,
+		std::vector<T>& left, std::vector<T>& right) {
+		std::stable_sort (grains.begin (), grains.end (),
+			[] (const Grain<T>& a, const Grain<T>& b) { return a.onset < b.onset; });
+		long len = 0;
+		m_maxDuration = 0;
+		for (unsigned i = 0; i < grains.size (); ++i) {
+			if (grains[i].onset + grains[i].duration > len) len = grains[i].onset + grains[i].duration;
+			if (grains[i].duration > m_maxDuration) m_maxDuration = grains[i].duration;
+		}
+		left.assign (len, 0);
+		right.assign (stereo ? len : 0, 0);
+		m_onsets.resize (grains.size ());
+		for (unsigned i = 0; i < grains.size (); ++i) m_onsets[i] = grains[i].onset;
+		int blocks = (int) ((len + BLOCK - 1) / BLOCK);
+		T* r = stereo ? &right[0] : nullptr;
+		if (threaded) {
+			ThreadPool::instance ().parallel_for (0, blocks, [&] (int b) {
+				block (grains, b, len, &left[0], r);
+			});
+		} else {
+			for (int b = 0; b < blocks; ++b) block (grains, b, len, &left[0], r);
+		}
+	}
+private:
+	void block (const std::vector<Grain<T> >& grains, long b, long len, T* left, T* right) const {
+		long start = b * BLOCK;
+		long end = start + BLOCK < len ? start + BLOCK : len;
+		// candidates: onset in (start - longest duration, end)
+		size_t first = std::upper_bound (m_onsets.begin (), m_onsets.end (), start - m_maxDuration) - m_onsets.begin ();
+		for (size_t g = first; g < grains.size () && grains[g].onset < end; ++g) {
+			const Grain<T>& gr = grains[g];
+			if (gr.duration <= 0 || gr.onset + gr.duration <= start) continue;
+			long from = gr.onset > start ? gr.onset : start;
+			long to = gr.onset + gr.duration < end ? gr.onset + gr.duration : end;
+			T gl = gr.amp, grt = 0;
+			if (right) {
+				T pan = gr.pan < 0 ? 0 : (gr.pan > 1 ? 1 : gr.pan);
+				gl = gr.amp * cos (pan * PI / 2);
+				grt = gr.amp * sin (pan * PI / 2);
+			}
+			T wincr = (T) WINDOW / gr.duration;
+			grain_segment<T, LANES> (m_source, m_len, &m_window[0], gr.position, gr.pitch, wincr,
+				from - gr.onset, (int) (to - from), gl, grt, left + from, right ? right + from : nullptr);
+		}
+	}
+	const T* m_source;
+	long m_len;
+	long m_maxDuration;
+	std::vector<T> m_window;
+	std::vector<long> m_onsets;
+};
+
+#endif	// GRANULAR_H
+
+// EOF
@@ -0,0 +1,380 @@
+// Graph.h
+//
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "Units.h"
+#include "WavFile.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+//! Processor with any number of inputs, used as a node of a Graph
+template <typename T>
+class GraphBlock {
+public:
+	virtual ~GraphBlock () {}
+	virtual void process (const T* const* in, int inputs, T* out, int n) = 0;
+	//! back to the state after construction (stateless blocks do nothing)
+	virtual void reset () {}
+};
+
+//! Node driven by a Unit: first input (or silence) in, unit output out
+template <typename T>
+class UnitBlock : public GraphBlock<T> {
+private:
+	UnitBlock& operator= (UnitBlock&);
+	UnitBlock (const UnitBlock&);
+public:
+	UnitBlock (Unit<T>* unit, int maxBlock) : m_zeros (maxBlock, 0) { m_unit = unit; }
+	virtual ~UnitBlock () { delete m_unit; }
+	void process (const T* const* in, int inputs, T* out, int n) {
+		m_unit->process (inputs ? in[0] : &m_zeros[0], out, n);
+	}
+	void reset () { m_unit->reset (); }
+private:
+	Unit<T>* m_unit;
+	std::vector<T> m_zeros;
+};
+
+//! Weighted sum of the inputs (missing gains are 1)
+template <typename T>
+class MixBlock : public GraphBlock<T> {
+public:
+	MixBlock (const std::vector<T>& gains) { m_gains = gains; }
+	void process (const T* const* in, int inputs, T* out, int n) {
+		for (int i = 0; i < n; ++i) out[i] = 0;
+		for (int k = 0; k < inputs; ++k) {
+			T g = k < (int) m_gains.size () ? m_gains[k] : 1;
+			const T* x = in[k];
+			for (int i = 0; i < n; ++i) out[i] += g * x[i];
+		}
+	}
+private:
+	std::vector<T> m_gains;
+};
+
+//! Product of the inputs (ring modulation, amplitude envelopes)
+template <typename T>
+class MulBlock : public GraphBlock<T> {
+public:
+	void process (const T* const* in, int inputs, T* out, int n) {
+		for (int i = 0; i < n; ++i) out[i] = inputs ? in[0][i] : 0;
+		for (int k = 1; k < inputs; ++k) {
+			const T* x = in[k];
+			for (int i = 0; i < n; ++i) out[i] *= x[i];
+		}
+	}
+};
+
+template <typename T>
+class ConstBlock : public GraphBlock<T> {
+public:
+	ConstBlock (T v) { m_value = v; }
+	void process (const T* const*, int, T* out, int n) {
+		for (int i = 0; i < n; ++i) out[i] = m_value;
+	}
+private:
+	T m_value;
+};
+
+//! One channel of a WAV file read block by block (silence after the end)
+template <typename T>
+class SndReadBlock : public GraphBlock<T> {
+private:
+	SndReadBlock& operator= (SndReadBlock&);
+	SndReadBlock (const SndReadBlock&);
+public:
+	SndReadBlock (const char* fileName, int channel, int maxBlock) : m_file (fileName) {
+		m_channels = m_file.getNumChannels ();
+		if (channel < 0 || channel >= m_channels) throw std::runtime_error ("invalid channel requested for sndread");
+		m_channel = channel;
+		m_buffer.resize (maxBlock * m_channels);
+	}
+	void process (const T* const*, int, T* out, int n) {
+		int got = m_file.eof () ? 0 : m_file.read (&m_buffer[0], n * m_channels) / m_channels;
+		for (int i = 0; i < got; ++i) out[i] = m_buffer[i * m_channels + m_channel] / (T) 32768.;
+		for (int i = got; i < n; ++i) out[i] = 0;
+	}
+	void reset () { m_file.rewind (); }
+private:
+	WavInFile m_file;
+	int m_channels;
+	int m_channel;
+	std::vector<short> m_buffer;
+};
+
+//! Graph of block processors rendered a block at a time
+/*!
+  Nodes are added with add and connected with connect (the inputs of a node
+  are numbered in the order of connection). prepare sorts the nodes
+  topologically (cycles are rejected) and assigns the output buffers. When
+  rendering serially the buffer of a node goes back to a pool after its last
+  reader, so the memory used depends on the width of the graph and on the
+  block size, not on the duration of the render; output nodes keep their
+  buffers.
+  With more than one thread every node has its own buffer and each block is
+  scheduled by work stealing: every worker owns a deque of ready nodes, runs
+  the most recent one and, when empty, steals the oldest node of another
+  worker; a node becomes ready when its last input is done. All the state is
+  allocated by prepare, nothing is allocated while rendering. The time of
+  every node is measured, giving the work and the critical path (longest
+  chain of dependent nodes) of each block.
+*/
+template <typename T>
+class Graph {
+private:
+	Graph& operator= (Graph&);
+	Graph (const Graph&);
+public:
+	//! threads = 0 uses the whole pool
+	Graph (int maxBlock, int threads = 0) {
+		m_maxBlock = maxBlock < 1 ? 1 : maxBlock;
+		m_requested = threads;
+		m_threads = 1;
+		m_prepared = false;
+		m_pending = nullptr;
+		m_remaining = 0;
+		resetStats ();
+	}
+	virtual ~Graph () {
+		for (unsigned i = 0; i < m_nodes.size (); ++i) delete m_nodes[i].block;
+		delete [] m_pending;
+	}
+	int maxBlock () const { return m_maxBlock; }
+	int size () const { return (int) m_nodes.size (); }
+	int threads () const { return m_threads; }
+	//! takes ownership of the block
+	int add (GraphBlock<T>* block) {
+		Node n;
+		n.block = block;
+		n.buffer = -1;
+		m_nodes.push_back (n);
+		m_prepared = false;
+		return (int) m_nodes.size () - 1;
+	}
+	void connect (int src, int dst) {
+		if (src < 0 || dst < 0 || src >= size () || dst >= size ()) throw std::runtime_error ("invalid nodes in graph connection");
+		m_nodes[dst].inputs.push_back (src);
+		m_prepared = false;
+	}
+	void prepare (const std::vector<int>& outputs) {
+		int count = size ();
+		for (unsigned i = 0; i < outputs.size (); ++i) {
+			if (outputs[i] < 0 || outputs[i] >= count) throw std::runtime_error ("invalid output node in graph");
+		}
+		// Kahn's algorithm
+		std::vector<int> pending (count, 0);
+		for (int i = 0; i < count; ++i) m_nodes[i].readers.clear ();
+		for (int i = 0; i < count; ++i) {
+			for (unsigned k = 0; k < m_nodes[i].inputs.size (); ++k) {
+				m_nodes[m_nodes[i].inputs[k]].readers.push_back (i);
+				++pending[i];
+			}
+		}
+		m_order.clear ();
+		for (int i = 0; i < count; ++i) if (pending[i] == 0) m_order.push_back (i);
+		for (unsigned p = 0; p < m_order.size (); ++p) {
+			const std::vector<int>& readers = m_nodes[m_order[p]].readers;
+			for (unsigned r = 0; r < readers.size (); ++r) {
+				if (--pending[readers[r]] == 0) m_order.push_back (readers[r]);
+			}
+		}
+		if ((int) m_order.size () != count) throw std::runtime_error ("cycle in graph");
+
+		m_threads = m_requested > 0 ? m_requested : ThreadPool::instance ().size ();
+		if (m_threads > count) m_threads = count;
+		if (m_threads < 1) m_threads = 1;
+		int buffers = 0;
+		if (m_threads > 1) {
+			for (int i = 0; i < count; ++i) m_nodes[i].buffer = buffers++;
+		} else {
+			// buffers reused once the last reader has run
+			std::vector<bool> keep (count, false);
+			for (unsigned i = 0; i < outputs.size (); ++i) keep[outputs[i]] = true;
+			std::vector<int> left (count);
+			for (int i = 0; i < count; ++i) left[i] = (int) m_nodes[i].readers.size ();
+			std::vector<int> pool;
+			for (unsigned p = 0; p < m_order.size (); ++p) {
+				Node& n = m_nodes[m_order[p]];
+				if (pool.empty ()) n.buffer = buffers++;
+				else {
+					n.buffer = pool.back ();
+					pool.pop_back ();
+				}
+				for (unsigned k = 0; k < n.inputs.size (); ++k) {
+					int src = n.inputs[k];
+					if (--left[src] == 0 && !keep[src]) pool.push_back (m_nodes[src].buffer);
+				}
+				if (left[m_order[p]] == 0 && !keep[m_order[p]]) pool.push_back (n.buffer);
+			}
+		}
+		m_buffers.assign (buffers * m_maxBlock, 0);
+		m_inputs.clear ();
+		for (int i = 0; i < count; ++i) {
+			m_nodes[i].first = (int) m_inputs.size ();
+			for (unsigned k = 0; k < m_nodes[i].inputs.size (); ++k) m_inputs.push_back (nullptr);
+		}
+		for (int i = 0; i < count; ++i) {
+			for (unsigned k = 0; k < m_nodes[i].inputs.size (); ++k) {
+				m_inputs[m_nodes[i].first + k] = buffer (m_nodes[i].inputs[k]);
+			}
+		}
+
+		// scheduler state
+		delete [] m_pending;
+		m_pending = new std::atomic<int>[count];
+		m_deques.clear ();
+		m_deques.resize (m_threads);
+		for (int w = 0; w < m_threads; ++w) m_deques[w].slots.resize (count);
+		m_time.assign (count, 0);
+		m_finish.assign (count, 0);
+		resetStats ();
+		m_prepared = true;
+	}
+	int buffers () const { return (int) m_buffers.size () / m_maxBlock; }
+	//! back to time 0: every node restarts as if just added
+	void reset () {
+		for (unsigned i = 0; i < m_nodes.size (); ++i) m_nodes[i].block->reset ();
+	}
+	//! renders the next n (at most maxBlock) samples of every node
+	void process (int n) {
+		if (!m_prepared) throw std::runtime_error ("graph not prepared");
+		m_n = n;
+		if (m_threads > 1) {
+			int count = size ();
+			for (int w = 0; w < m_threads; ++w) m_deques[w].head = m_deques[w].tail = 0;
+			int w = 0;
+			for (int i = 0; i < count; ++i) {
+				m_pending[i].store ((int) m_nodes[i].inputs.size (), std::memory_order_relaxed);
+				if (m_nodes[i].inputs.empty ()) {
+					// sources spread over the workers
+					m_deques[w].slots[m_deques[w].tail++] = i;
+					w = (w + 1) % m_threads;
+				}
+			}
+			m_remaining.store (count);
+			ThreadPool::instance ().parallel_for (0, m_threads, [this] (int w) { work (w); });
+		} else {
+			for (unsigned p = 0; p < m_order.size (); ++p) run (m_order[p]);
+		}
+		stats ();
+	}
+	//! valid after process for the output nodes
+	const T* output (int node) const { return &m_buffers[m_nodes[node].buffer * m_maxBlock]; }
+	long blocks () const { return m_blocks; }
+	double work () const { return m_work; } //!< total time of the nodes (seconds)
+	double criticalPath () const { return m_critical; } //!< summed over the blocks (seconds)
+	double maxCriticalPath () const { return m_maxCritical; } //!< longest block (seconds)
+	void resetStats () {
+		m_blocks = 0;
+		m_work = 0;
+		m_critical = 0;
+		m_maxCritical = 0;
+	}
+private:
+	struct Node {
+		GraphBlock<T>* block;
+		std::vector<int> inputs;
+		std::vector<int> readers;
+		int buffer;
+		int first;
+	};
+	//! ready nodes of a worker: the owner uses the tail, thieves the head
+	struct Deque {
+		Deque () : head (0), tail (0) {}
+		Deque (const Deque& d) : slots (d.slots), head (d.head), tail (d.tail) {}
+		std::mutex lock;
+		std::vector<int> slots;
+		int head;
+		int tail;
+	};
+	T* buffer (int node) { return &m_buffers[m_nodes[node].buffer * m_maxBlock]; }
+	void run (int i) {
+		Node& node = m_nodes[i];
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+		node.block->process (node.inputs.empty () ? nullptr : &m_inputs[node.first],
+			(int) node.inputs.size (), buffer (i), m_n);
+		m_time[i] = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+	}
+	int pop (int w) {
+		Deque& d = m_deques[w];
+		std::lock_guard<std::mutex> guard (d.lock);
+		return d.tail > d.head ? d.slots[--d.tail] : -1;
+	}
+	int steal (int w) {
+		for (int k = 1; k < m_threads; ++k) {
+			Deque& d = m_deques[(w + k) % m_threads];
+			std::lock_guard<std::mutex> guard (d.lock);
+			if (d.tail > d.head) return d.slots[d.head++];
+		}
+		return -1;
+	}
+	void push (int w, int i) {
+		Deque& d = m_deques[w];
+		std::lock_guard<std::mutex> guard (d.lock);
+		d.slots[d.tail++] = i;
+	}
+	void work (int w) {
+		while (m_remaining.load (std::memory_order_acquire) > 0) {
+			int i = pop (w);
+			if (i < 0) i = steal (w);
+			if (i < 0) {
+				std::this_thread::yield ();
+				continue;
+			}
+			run (i);
+			const std::vector<int>& readers = m_nodes[i].readers;
+			for (unsigned r = 0; r < readers.size (); ++r) {
+				if (m_pending[readers[r]].fetch_sub (1, std::memory_order_acq_rel) == 1) push (w, readers[r]);
+			}
+			m_remaining.fetch_sub (1, std::memory_order_acq_rel);
+		}
+	}
+	void stats () {
+		// longest chain of node times, in topological order
+		double block = 0, critical = 0;
+		for (unsigned p = 0; p < m_order.size (); ++p) {
+			int i = m_order[p];
+			double start = 0;
+			const std::vector<int>& inputs = m_nodes[i].inputs;
+			for (unsigned k = 0; k < inputs.size (); ++k) {
+				if (m_finish[inputs[k]] > start) start = m_finish[inputs[k]];
+			}
+			m_finish[i] = start + m_time[i];
+			if (m_finish[i] > critical) critical = m_finish[i];
+			block += m_time[i];
+		}
+		++m_blocks;
+		m_work += block;
+		m_critical += critical;
+		if (critical > m_maxCritical) m_maxCritical = critical;
+	}
+	int m_maxBlock;
+	int m_requested;
+	int m_threads;
+	bool m_prepared;
+	int m_n;
+	std::vector<Node> m_nodes;
+	std::vector<int> m_order;
+	std::vector<T> m_buffers;
+	std::vector<const T*> m_inputs;
+	std::atomic<int>* m_pending;
+	std::atomic<int> m_remaining;
+	std::vector<Deque> m_deques;
+	std::vector<double> m_time;
+	std::vector<double> m_finish;
+	long m_blocks;
+	double m_work;
+	double m_critical;
+	double m_maxCritical;
+};
+
+#endif	// GRAPH_H
+
+// EOF
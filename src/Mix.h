@@ -0,0 +1,119 @@
+// Mix.h
+//
+
+#ifndef MIX_H
+#define MIX_H
+
+#include "FFT.h"
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cmath>
+
+//! out[i] += gain * in[i], W samples at a time
+template <typename T, int W>
+SIMD_CLONES void mix_add (T* out, const T* in, long n, T gain) {
+	typedef typename SimdVec<T, W>::type V;
+	V g, x, y;
+	simd_set1 (g, gain);
+	long i = 0;
+	for (; i + W <= n; i += W) {
+		simd_load (x, in + i);
+		simd_load (y, out + i);
+		y += g * x;
+		simd_store (out + i, y);
+	}
+	for (; i < n; ++i) out[i] += gain * in[i];
+}
+
+//! Sum of signals placed at given offsets, on one or more channels
+/*!
+  The length of the result is known once all the inputs are added, so the
+  output channels are allocated once by the caller and accumulated in place.
+  The pan of an input goes from 0 (first channel) to channels - 1 (last
+  channel), with an equal-power law between the two nearest channels; on one
+  channel it is ignored. The output is cut in chunks of CHUNK samples that
+  can be spread over the thread pool: each chunk adds the inputs overlapping
+  it in the order they were given, so the result does not depend on the
+  number of threads.
+*/
+template <typename T>
+class Mixer {
+private:
+	Mixer& operator= (Mixer&);
+	Mixer (const Mixer&);
+	static const int LANES = 4;
+	static const long CHUNK = 1 << 16;
+	struct Input {
+		long offset;
+		const T* data;
+		long len;
+		T gain;
+		T pan;
+	};
+public:
+	Mixer () { m_length = 0; }
+	virtual ~Mixer () {}
+	//! the data must stay valid until process
+	void add (long offset, const T* data, long len, T gain = 1, T pan = 0) {
+		Input in;
+		in.offset = offset < 0 ? 0 : offset;
+		in.data = data;
+		in.len = len < 0 ? 0 : len;
+		in.gain = gain;
+		in.pan = pan;
+		m_inputs.push_back (in);
+		if (in.offset + in.len > m_length) m_length = in.offset + in.len;
+	}
+	int inputs () const { return (int) m_inputs.size (); }
+	long length () const { return m_length; }
+	//! adds the inputs to out[0 .. channels - 1], of length () samples each
+	void process (T* const* out, int channels, bool threaded) const {
+		if (channels < 1) return;
+		std::vector<T> gains (m_inputs.size () * channels, 0);
+		for (unsigned k = 0; k < m_inputs.size (); ++k) {
+			T* g = &gains[k * channels];
+			if (channels == 1) {
+				g[0] = m_inputs[k].gain;
+				continue;
+			}
+			T pan = m_inputs[k].pan < 0 ? 0 : (m_inputs[k].pan > channels - 1 ? channels - 1 : m_inputs[k].pan);
+			int c = (int) pan;
+			if (c == channels - 1) c = channels - 2;
+			T frac = pan - c;
+			g[c] = m_inputs[k].gain * cos (frac * PI / 2);
+			g[c + 1] = m_inputs[k].gain * sin (frac * PI / 2);
+		}
+		long chunks = (m_length + CHUNK - 1) / CHUNK;
+		if (threaded && chunks > 1) {
+			ThreadPool::instance ().parallel_for (0, (int) chunks, [&] (int b) {
+				chunk (b, &gains[0], out, channels);
+			});
+		} else {
+			for (long b = 0; b < chunks; ++b) chunk (b, &gains[0], out, channels);
+		}
+	}
+private:
+	void chunk (long b, const T* gains, T* const* out, int channels) const {
+		long start = b * CHUNK;
+		long end = start + CHUNK < m_length ? start + CHUNK : m_length;
+		for (unsigned k = 0; k < m_inputs.size (); ++k) {
+			const Input& in = m_inputs[k];
+			long from = in.offset > start ? in.offset : start;
+			long to = in.offset + in.len < end ? in.offset + in.len : end;
+			if (from >= to) continue;
+			for (int c = 0; c < channels; ++c) {
+				T g = gains[k * channels + c];
+				if (g == 0) continue;
+				mix_add<T, LANES> (out[c] + from, in.data + (from - in.offset), to - from, g);
+			}
+		}
+	}
+	std::vector<Input> m_inputs;
+	long m_length;
+};
+
+#endif	// MIX_H
+
+// EOF
@@ -0,0 +1,215 @@
+// Onsets.h
+//
+
+#ifndef ONSETS_H
+#define ONSETS_H
+
+#include "FFT.h"
+
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <stdexcept>
+
+template <typename T>
+void swapElem (T& a, T& b) {
+	T t = (a); (a) = (b); (b) = t;
+}
+
+//! k-th smallest of the n values in a (partially reorders a)
+template <typename T>
+T kth_smallest (T a[], int n, int k) {
+	int i, j, l, m;
+	T x ;
+	l = 0 ; m = n - 1 ;
+	while (l < m) {
+		x = a[k];
+		i = l;
+		j= m;
+		do {
+			while (a[i] < x) i++;
+			while (x < a[j]) j--;
+			if (i <= j) {
+				swapElem (a[i], a[j]);
+				i++; j--;
+			}
+		} while (i <= j) ;
+		if (j < k) l = i;
+		if (k < i) m = j;
+	}
+	return a[k] ;
+}
+
+template <typename T>
+T median (T a[], int n) {
+	return kth_smallest (a, n, (((n) & 1) ? ((n) / 2):(((n) / 2) -1)));
+}
+
+//! Detection functions available to OnsetDetector
+enum OnsetMethod {ONSET_FLUX, ONSET_COMPLEX, ONSET_HFC};
+
+//! Streaming onset detector
+/*!
+  Samples are pushed in blocks of any size; every hop samples a frame of N
+  samples (centred on the hop, the stream being preceded by N / 2 zeros) gives
+  one value of the detection function: half-wave rectified spectral flux,
+  complex-domain distance from the predicted spectrum, or high-frequency content.
+  Peaks are picked with an adaptive threshold, lambda times the median of the
+  2 * width + 1 surrounding values plus delta times their mean, so a decision
+  waits width frames; flush decides the last ones. Onsets closer than gap
+  seconds to the previous one are ignored. Memory does not depend on the
+  length of the stream.
+*/
+template <typename T>
+class OnsetDetector {
+private:
+	OnsetDetector& operator= (OnsetDetector&);
+	OnsetDetector (const OnsetDetector&);
+public:
+	OnsetDetector (int N, int hop, T sr, OnsetMethod method, T lambda, T delta, int width, T gap) :
+		m_fft (N) {
+		if (hop > N) throw std::runtime_error ("hop larger than the frame requested for onset detection");
+		m_N = N;
+		m_bins = N / 2 + 1;
+		m_hop = hop < 1 ? 1 : hop;
+		m_sr = sr;
+		m_method = method;
+		m_lambda = lambda;
+		m_delta = delta;
+		m_width = width < 1 ? 1 : width;
+		m_gap = gap;
+		m_window.resize (N);
+		hanningz (&m_window[0], N);
+		m_frame.resize (N + 2);
+		m_spectrum.resize (N + 2);
+		m_mag.resize (m_bins, 0);
+		m_phi.resize (m_bins, 0);
+		m_prevMag.resize (m_bins, 0);
+		m_prevPhi.resize (m_bins, 0);
+		m_prevPhi2.resize (m_bins, 0);
+		m_fifo.assign (N / 2, 0);
+		m_frames = 0;
+		m_decided = 0;
+		m_last = -1e9;
+	}
+	virtual ~OnsetDetector () {}
+	//! analyses n more samples, appending the detected onsets (seconds)
+	void process (const T* in, int n, std::vector<T>& onsets) {
+		for (int i = 0; i < n; ++i) {
+			m_fifo.push_back (in[i]);
+			if ((int) m_fifo.size () == m_N) {
+				m_odf.push_back (detection ());
+				++m_frames;
+				m_fifo.erase (m_fifo.begin (), m_fifo.begin () + m_hop);
+				pick (onsets, false);
+			}
+		}
+	}
+	//! completes the last frames (the stream is followed by zeros)
+	void flush (std::vector<T>& onsets) {
+		int tail = m_N / 2;
+		std::vector<T> zeros (m_hop, 0);
+		while (tail > 0) {
+			process (&zeros[0], m_hop, onsets);
+			tail -= m_hop;
+		}
+		pick (onsets, true);
+	}
+	const std::deque<T>& detectionFunction () const { return m_odf; }
+private:
+	T detection () {
+		for (int i = 0; i < m_N; ++i) m_frame[i] = m_fifo[i] * m_window[i];
+		m_fft.forward (&m_frame[0], &m_spectrum[0]);
+		for (int k = 0; k < m_bins; ++k) {
+			T re = m_spectrum[2 * k], im = m_spectrum[2 * k + 1];
+			m_mag[k] = sqrt (re * re + im * im);
+			m_phi[k] = atan2 (im, re);
+		}
+		T v = 0;
+		switch (m_method) {
+		case ONSET_FLUX:
+			for (int k = 0; k < m_bins; ++k) {
+				T d = m_mag[k] - m_prevMag[k];
+				if (d > 0) v += d;
+			}
+		break;
+		case ONSET_COMPLEX:
+			for (int k = 0; k < m_bins; ++k) {
+				// target: previous magnitude, phase extrapolated from the last two frames
+				T phi = 2 * m_prevPhi[k] - m_prevPhi2[k];
+				T re = m_mag[k] * cos (m_phi[k]) - m_prevMag[k] * cos (phi);
+				T im = m_mag[k] * sin (m_phi[k]) - m_prevMag[k] * sin (phi);
+				v += sqrt (re * re + im * im);
+			}
+		break;
+		case ONSET_HFC:
+			for (int k = 0; k < m_bins; ++k) v += k * m_mag[k] * m_mag[k];
+			v /= m_bins;
+		break;
+		}
+		m_prevPhi2.swap (m_prevPhi);
+		m_prevPhi.swap (m_phi);
+		m_prevMag.swap (m_mag);
+		return v / m_N;
+	}
+	void pick (std::vector<T>& onsets, bool all) {
+		// m_odf holds the values from frame m_frames - m_odf.size ()
+		long first = m_frames - (long) m_odf.size ();
+		long last = all ? m_frames - 1 : m_frames - 1 - m_width;
+		std::vector<T> neighbours;
+		while (m_decided <= last) {
+			long f = m_decided;
+			long lo = f - m_width < first ? first : f - m_width;
+			long hi = f + m_width > m_frames - 1 ? m_frames - 1 : f + m_width;
+			neighbours.clear ();
+			T mean = 0;
+			for (long j = lo; j <= hi; ++j) {
+				neighbours.push_back (m_odf[j - first]);
+				mean += m_odf[j - first];
+			}
+			mean /= neighbours.size ();
+			T threshold = m_lambda * median (&neighbours[0], (int) neighbours.size ()) + m_delta * mean;
+			T v = m_odf[f - first];
+			bool peak = v > threshold
+				&& (f == first || v > m_odf[f - 1 - first])
+				&& (f == m_frames - 1 || v >= m_odf[f + 1 - first]);
+			T time = (T) f * m_hop / m_sr;
+			if (peak && f > 0 && time - m_last >= m_gap) {
+				onsets.push_back (time);
+				m_last = time;
+			}
+			++m_decided;
+		}
+		// keep only what the next decisions need
+		while ((long) m_odf.size () > 2 * m_width + 2 && m_frames - (long) m_odf.size () < m_decided - m_width - 1) {
+			m_odf.pop_front ();
+		}
+	}
+	RealFFT<T> m_fft;
+	int m_N;
+	int m_bins;
+	int m_hop;
+	T m_sr;
+	OnsetMethod m_method;
+	T m_lambda;
+	T m_delta;
+	int m_width;
+	T m_gap;
+	std::vector<T> m_window;
+	std::vector<T> m_frame;
+	std::vector<T> m_spectrum;
+	std::vector<T> m_mag;
+	std::vector<T> m_phi;
+	std::vector<T> m_prevMag;
+	std::vector<T> m_prevPhi;
+	std::vector<T> m_prevPhi2;
+	std::deque<T> m_fifo;
+	std::deque<T> m_odf;
+	long m_frames;
+	long m_decided;
+	T m_last;
+};
+
+#endif	// ONSETS_H
+
+// EOF
@@ -0,0 +1,142 @@
+// OscBank.h
+//
+
+#ifndef OSCBANK_H
+#define OSCBANK_H
+
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+//! W table-lookup oscillators in the lanes of a vector, accumulated in acc
+/*!
+  Same recurrence as osc: the output uses the phase before the increment and
+  the phase wraps at the table size. Lookups are gathered lane by lane, the
+  interpolation and the amplitude scaling run on the whole vector.
+*/
+template <typename T, int W>
+SIMD_INLINE void oscbank_lanes (const T* table, T size, T rfn,
+	const T* const* amps, const T* const* freqs, T* phases,
+	long t0, int n, typename SimdVec<T, W>::type* acc) {
+	typedef typename SimdVec<T, W>::type V;
+	V phi, a, f, lo, hi, frac, one;
+	simd_load (phi, phases);
+	simd_set1 (one, (T) 1);
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < W; ++j) {
+			int ip = (int) phi[j];
+			frac[j] = phi[j] - ip;
+			lo[j] = table[ip];
+			hi[j] = table[ip + 1];
+			a[j] = amps[j][t0 + i];
+			f[j] = freqs[j][t0 + i];
+		}
+		acc[i] += a * ((one - frac) * lo + frac * hi);
+		phi += f * rfn;
+		for (int j = 0; j < W; ++j) {
+			if (phi[j] >= size) phi[j] -= size;
+			else if (phi[j] < 0) phi[j] += size;
+		}
+	}
+	simd_store (phases, phi);
+}
+
+//! Bank of table-lookup oscillators with time-varying amplitudes and frequencies
+/*!
+  The output is rendered in blocks of BLOCK samples. In each block, partials
+  are processed LANES at a time in the vector lanes and summed in a local
+  accumulator, so every partial reads its envelopes once and the output is
+  written once per block. With more than one thread the phases at the start
+  of each block are found first (in parallel over partials, using the same
+  recurrence, so the result does not depend on the number of threads) and the
+  blocks are then spread over the pool.
+*/
+template <typename T>
+class OscBank {
+private:
+	OscBank& operator= (OscBank&);
+	OscBank (const OscBank&);
+	static const int LANES = 4;
+	static const int BLOCK = 4096;
+	typedef typename SimdVec<T, LANES>::type V;
+public:
+	//! table has size + 1 points (guard point, as made by gen)
+	OscBank (const T* table, int size, T sr) {
+		m_table = table;
+		m_size = size;
+		m_rfn = (T) size / sr;
+	}
+	virtual ~OscBank () {}
+	void process (const std::vector<const T*>& amps, const std::vector<const T*>& freqs,
+		long len, T* out) {
+		int partials = (int) amps.size ();
+		long blocks = (len + BLOCK - 1) / BLOCK;
+		ThreadPool& pool = ThreadPool::instance ();
+		bool threaded = pool.size () > 1 && blocks > 1;
+		// phases[b * partials + p]: phase of partial p at the start of block b
+		std::vector<T> phases ((threaded ? blocks : 1) * partials, 0);
+		if (threaded) {
+			pool.parallel_for (0, partials, [&] (int p) {
+				T phi = 0;
+				const T* f = freqs[p];
+				for (long b = 0; b < blocks; ++b) {
+					phases[b * partials + p] = phi;
+					long end = (b + 1) * BLOCK < len ? (b + 1) * BLOCK : len;
+					for (long t = b * BLOCK; t < end; ++t) {
+						phi += f[t] * m_rfn;
+						if (phi >= m_size) phi -= m_size;
+						else if (phi < 0) phi += m_size;
+					}
+				}
+			});
+			pool.parallel_for (0, (int) blocks, [&] (int b) {
+				render (amps, freqs, b, len, &phases[b * partials], out);
+			});
+		} else {
+			for (long b = 0; b < blocks; ++b) render (amps, freqs, b, len, &phases[0], out);
+		}
+	}
+private:
+	void render (const std::vector<const T*>& amps, const std::vector<const T*>& freqs,
+		long b, long len, T* phases, T* out) const {
+		int partials = (int) amps.size ();
+		long t0 = b * BLOCK;
+		int n = (int) (t0 + BLOCK < len ? BLOCK : len - t0);
+		std::vector<V> acc (n);
+		V zero;
+		simd_set1 (zero, (T) 0);
+		for (int i = 0; i < n; ++i) acc[i] = zero;
+		int p = 0;
+		for (; p + LANES <= partials; p += LANES) {
+			oscbank_lanes<T, LANES> (m_table, (T) m_size, m_rfn, &amps[p], &freqs[p], &phases[p], t0, n, &acc[0]);
+		}
+		for (int i = 0; i < n; ++i) {
+			T s = 0;
+			for (int j = 0; j < LANES; ++j) s += acc[i][j];
+			out[t0 + i] = s;
+		}
+		for (; p < partials; ++p) {
+			// remaining partials, one at a time
+			T phi = phases[p];
+			const T* a = amps[p];
+			const T* f = freqs[p];
+			for (int i = 0; i < n; ++i) {
+				int ip = (int) phi;
+				T frac = phi - ip;
+				out[t0 + i] += a[t0 + i] * ((1 - frac) * m_table[ip] + frac * m_table[ip + 1]);
+				phi += f[t0 + i] * m_rfn;
+				if (phi >= m_size) phi -= m_size;
+				else if (phi < 0) phi += m_size;
+			}
+			phases[p] = phi;
+		}
+	}
+	const T* m_table;
+	int m_size;
+	T m_rfn;
+};
+
+#endif	// OSCBANK_H
+
+// EOF
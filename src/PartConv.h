@@ -0,0 +1,125 @@
+// PartConv.h
+//
+
+#ifndef PARTCONV_H
+#define PARTCONV_H
+
+#include "BlockConv.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+//! Non-uniformly partitioned convolution for long impulse responses
+/*!
+  The head of the response is convolved with small blocks (latency is one block
+  of blockSize samples), the tail with blocks that double in size up to
+  maxBlockSize. Stage k uses blocks of B_k samples starting at offset O_k in the
+  response, with O_k >= B_k - blockSize so that its output is ready before it is
+  needed; each stage is a BlockConv with its own FFT setup. Outputs are summed
+  in a circular accumulator. The cost of every call to process is measured.
+*/
+template <typename T>
+class PartConv {
+private:
+	PartConv& operator= (PartConv&);
+	PartConv (const PartConv&);
+	struct Stage {
+		BlockConv<T>* conv;
+		int size;
+		int offset;
+		int length;
+		int filled;
+		std::vector<T> in;
+		std::vector<T> out;
+	};
+public:
+	PartConv (const T* imp, int impSize, int blockSize, int maxBlockSize, T scale) {
+		m_bsize = blockSize;
+		if (maxBlockSize < blockSize) maxBlockSize = blockSize;
+		int offset = 0;
+		int size = blockSize;
+		int reach = 0;
+		while (offset < impSize) {
+			// two partitions per size, the last size takes the rest
+			int len = size < maxBlockSize ? 2 * size : impSize - offset;
+			if (len > impSize - offset) len = impSize - offset;
+			Stage s;
+			s.conv = new BlockConv<T> (imp + offset, nullptr, len, size, scale);
+			s.size = size;
+			s.offset = offset;
+			s.length = len;
+			s.filled = 0;
+			s.in.resize (size);
+			s.out.resize (size);
+			m_stages.push_back (s);
+			if (offset + size > reach) reach = offset + size;
+			offset += len;
+			if (size < maxBlockSize) size <<= 1;
+		}
+		m_ringSize = 1;
+		while (m_ringSize < reach + blockSize) m_ringSize <<= 1;
+		m_ring.resize (m_ringSize, 0);
+		m_time = 0;
+		m_calls = 0;
+		m_total = 0;
+		m_max = 0;
+	}
+	virtual ~PartConv () {
+		for (unsigned i = 0; i < m_stages.size (); ++i) delete m_stages[i].conv;
+	}
+	void process (const T* input, T* output) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+		int mask = m_ringSize - 1;
+		for (unsigned k = 0; k < m_stages.size (); ++k) {
+			Stage& s = m_stages[k];
+			memcpy (&s.in[s.filled], input, m_bsize * sizeof (T));
+			s.filled += m_bsize;
+			if (s.filled < s.size) continue;
+			s.filled = 0;
+			s.conv->process (&s.in[0], &s.out[0]);
+			// the block started at m_time + m_bsize - size; its output goes offset later
+			long dst = m_time + m_bsize - s.size + s.offset;
+			for (int i = 0; i < s.size; ++i) m_ring[(dst + i) & mask] += s.out[i];
+		}
+		for (int i = 0; i < m_bsize; ++i) {
+			output[i] = m_ring[(m_time + i) & mask];
+			m_ring[(m_time + i) & mask] = 0;
+		}
+		m_time += m_bsize;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+		++m_calls;
+		m_total += elapsed.count ();
+		if (elapsed.count () > m_max) m_max = elapsed.count ();
+	}
+	//! clears the past input (the costs measured are kept)
+	void reset () {
+		for (unsigned k = 0; k < m_stages.size (); ++k) {
+			m_stages[k].conv->reset ();
+			m_stages[k].filled = 0;
+		}
+		std::fill (m_ring.begin (), m_ring.end (), 0);
+		m_time = 0;
+	}
+	int blockSize () const { return m_bsize; }
+	int stages () const { return (int) m_stages.size (); }
+	int stageSize (int k) const { return m_stages[k].size; }
+	int stageOffset (int k) const { return m_stages[k].offset; }
+	int stageBlocks (int k) const { return m_stages[k].conv->blocks (); }
+	long calls () const { return m_calls; }
+	double meanCost () const { return m_calls ? m_total / m_calls : 0; } // seconds per block
+	double maxCost () const { return m_max; }
+private:
+	std::vector<Stage> m_stages;
+	std::vector<T> m_ring;
+	int m_ringSize;
+	int m_bsize;
+	long m_time;
+	long m_calls;
+	double m_total;
+	double m_max;
+};
+
+#endif	// PARTCONV_H
+
+// EOF
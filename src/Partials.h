@@ -0,0 +1,170 @@
+// Partials.h
+//
+
+#ifndef PARTIALS_H
+#define PARTIALS_H
+
+#include "FFT.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cmath>
+
+//! Amplitude and frequency track of a sinusoid, one value per analysis frame
+template <typename T>
+struct Partial {
+	int start; // first frame
+	int length; // frames with a matching peak (fades excluded)
+	std::vector<T> amps;
+	std::vector<T> freqs;
+};
+
+//! Sinusoidal analysis: peak picking and frame-to-frame partial tracking
+/*!
+  Frames of N samples are centred every hop samples. In each frame the local
+  maxima of the magnitude spectrum above threshold (dB) are refined by parabolic
+  interpolation on the dB values and the strongest maxPeaks are kept. Peaks are
+  then matched, strongest first, to the closest active partial within maxDelta
+  Hz; unmatched partials die and unmatched peaks start new partials. Births and
+  deaths get a zero-amplitude frame so that the tracks can be resynthesized
+  without clicks. Peak picking is spread over the thread pool, tracking is serial.
+*/
+template <typename T>
+class PartialTracker {
+private:
+	PartialTracker& operator= (PartialTracker&);
+	PartialTracker (const PartialTracker&);
+public:
+	PartialTracker (int N, int hop, T sr, int maxPeaks, T threshold, T maxDelta, int minLength) {
+		if (N < 8 || (N & (N - 1))) throw std::runtime_error ("invalid size requested for partial tracking");
+		m_N = N;
+		m_hop = hop < 1 ? 1 : hop;
+		m_sr = sr;
+		m_maxPeaks = maxPeaks < 1 ? 1 : maxPeaks;
+		m_threshold = threshold;
+		m_maxDelta = maxDelta;
+		m_minLength = minLength;
+		m_window.resize (N);
+		hanningz (&m_window[0], N);
+		T sum = 0;
+		for (int i = 0; i < N; ++i) sum += m_window[i];
+		m_norm = 2. / sum; // peak magnitude to sinusoid amplitude
+	}
+	virtual ~PartialTracker () {}
+	//! peaks of the frame starting at in[start], strongest first; work has 2 N + 2 values
+	void peaks (RealFFT<T>& fft, const T* in, long len, long start,
+		std::vector<Peak<T> >& out, std::vector<T>& work) const {
+		T* frame = &work[m_N + 2];
+		for (int i = 0; i < m_N; ++i) {
+			long t = start + i;
+			frame[i] = t >= 0 && t < len ? in[t] * m_window[i] : 0;
+		}
+		fft.forward (frame, &work[0]);
+		int bins = m_N / 2 + 1;
+		for (int k = 0; k < bins; ++k) {
+			T re = work[2 * k], im = work[2 * k + 1];
+			frame[k] = 20 * log10 (sqrt (re * re + im * im) * m_norm + 1e-20);
+		}
+		out.clear ();
+		T binHz = m_sr / m_N;
+		for (int k = 1; k < bins - 1; ++k) {
+			if (frame[k] > m_threshold && frame[k] > frame[k - 1] && frame[k] >= frame[k + 1]) {
+				Peak<T> p;
+				T db;
+				p.freq = parabolicInterpolate<T> (binHz * (k - 1), binHz * k, binHz * (k + 1),
+					frame[k - 1], frame[k], frame[k + 1], &db);
+				p.amp = pow (10., db / 20.);
+				out.push_back (p);
+			}
+		}
+		int n = (int) out.size () < m_maxPeaks ? (int) out.size () : m_maxPeaks;
+		if (out.size ()) sortSpectrum (&out[0], (int) out.size (), n);
+		out.resize (n);
+	}
+	void process (const T* in, long len, std::vector<Partial<T> >& partials) {
+		long frames = (len + m_hop - 1) / m_hop;
+		std::vector<std::vector<Peak<T> > > framePeaks (frames);
+		ThreadPool& pool = ThreadPool::instance ();
+		int chunks = pool.size () * 4;
+		if (chunks > frames) chunks = (int) frames;
+		pool.parallel_for (0, chunks, [&] (int c) {
+			RealFFT<T> fft (m_N);
+			std::vector<T> work (2 * m_N + 2);
+			for (long f = frames * c / chunks; f < frames * (c + 1) / chunks; ++f) {
+				peaks (fft, in, len, f * m_hop - m_N / 2, framePeaks[f], work);
+			}
+		});
+
+		partials.clear ();
+		std::vector<int> active; // indices in partials
+		std::vector<int> next;
+		std::vector<bool> taken;
+		for (long f = 0; f < frames; ++f) {
+			std::vector<Peak<T> >& pk = framePeaks[f];
+			taken.assign (active.size (), false);
+			next.clear ();
+			for (unsigned i = 0; i < pk.size (); ++i) {
+				int best = -1;
+				T dist = m_maxDelta;
+				for (unsigned j = 0; j < active.size (); ++j) {
+					if (taken[j]) continue;
+					T d = fabs (partials[active[j]].freqs.back () - pk[i].freq);
+					if (d <= dist) {
+						dist = d;
+						best = j;
+					}
+				}
+				if (best >= 0) {
+					taken[best] = true;
+					Partial<T>& p = partials[active[best]];
+					p.amps.push_back (pk[i].amp);
+					p.freqs.push_back (pk[i].freq);
+					++p.length;
+					next.push_back (active[best]);
+				} else {
+					Partial<T> p;
+					p.start = (int) f;
+					p.length = 1;
+					if (f > 0) {
+						--p.start;
+						p.amps.push_back (0);
+						p.freqs.push_back (pk[i].freq);
+					}
+					p.amps.push_back (pk[i].amp);
+					p.freqs.push_back (pk[i].freq);
+					next.push_back ((int) partials.size ());
+					partials.push_back (p);
+				}
+			}
+			for (unsigned j = 0; j < active.size (); ++j) {
+				if (taken[j]) continue;
+				Partial<T>& p = partials[active[j]];
+				p.amps.push_back (0);
+				p.freqs.push_back (p.freqs.back ());
+			}
+			active.swap (next);
+		}
+		unsigned k = 0;
+		for (unsigned i = 0; i < partials.size (); ++i) {
+			if (partials[i].length >= m_minLength) {
+				if (k != i) partials[k] = partials[i];
+				++k;
+			}
+		}
+		partials.resize (k);
+	}
+private:
+	int m_N;
+	int m_hop;
+	T m_sr;
+	int m_maxPeaks;
+	T m_threshold;
+	T m_maxDelta;
+	int m_minLength;
+	T m_norm;
+	std::vector<T> m_window;
+};
+
+#endif	// PARTIALS_H
+
+// EOF
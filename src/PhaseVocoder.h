@@ -0,0 +1,210 @@
+// PhaseVocoder.h
+//
+
+#ifndef PHASEVOCODER_H
+#define PHASEVOCODER_H
+
+#include "FFT.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+//! Peak-locked phase vocoder for time-stretching and pitch-shifting
+/*!
+  Adapted from BlockVocoder. Each frame goes through three stages: analysis
+  (window, FFT, polar form), phase propagation and synthesis (frequency-domain
+  transposition, inverse FFT, window). Only propagation depends on the previous
+  frame, so analysis and synthesis are const and can run on many frames at once
+  as long as every thread brings its own RealFFT; process does exactly that on
+  batches of frames and keeps the propagation and the overlap-add serial.
+  The synthesis hop is fixed (N / overlap); the analysis hop follows the stretch
+  factor, so stretch and transposition can change from one frame to the next.
+*/
+template <typename T>
+class PhaseVocoder {
+private:
+	PhaseVocoder& operator= (PhaseVocoder&);
+	PhaseVocoder (const PhaseVocoder&);
+public:
+	PhaseVocoder (int N, int overlap) {
+		if (N < 8 || (N & (N - 1))) throw std::runtime_error ("invalid size requested for phase vocoder");
+		if (overlap < 2 || overlap > N) throw std::runtime_error ("invalid overlap requested for phase vocoder");
+		m_N = N;
+		m_N2 = N / 2;
+		m_hop = N / overlap;
+		m_window.resize (N);
+		hanningz (&m_window[0], N);
+		m_oldAnPhi.resize (m_N2 + 1, 0);
+		m_oldSynPhi.resize (m_N2 + 1, 0);
+		m_psi.resize (m_N2 + 1, 0);
+		m_phaseInc.resize (m_N2 + 1, 0);
+		m_peaks.resize (m_N2 + 1, 0);
+	}
+	virtual ~PhaseVocoder () {}
+	int size () const { return m_N; }
+	int hop () const { return m_hop; }
+	void reset () {
+		std::fill (m_oldAnPhi.begin (), m_oldAnPhi.end (), 0);
+		std::fill (m_oldSynPhi.begin (), m_oldSynPhi.end (), 0);
+	}
+	//! frame (N samples) to amp/phase pairs (N / 2 + 1 bins); frame is overwritten
+	void analysis (RealFFT<T>& fft, T* frame, T* spectrum) const {
+		for (int i = 0; i < m_N; ++i) frame[i] *= m_window[i];
+		fftshift<T> (frame, m_N); // zero phase at the centre of the frame
+		fft.forward (frame, spectrum);
+		rect2pol<T> (spectrum, m_N2 + 1);
+	}
+	//! phases of the next frame given the analysis hop D and the transposition P
+	void propagate (T* spectrum, int D, T P) {
+		T sicvt = TWOPI / (T) m_N;
+		for (int i = 0; i <= m_N2; ++i) {
+			T omega = sicvt * (T) i * D;
+			T delta = princarg<T> (spectrum[2 * i + 1] - m_oldAnPhi[i] - omega);
+			m_phaseInc[i] = P * (omega + delta) / D;
+		}
+		int peaksNum = locmax2 (spectrum, m_N2 + 1, &m_peaks[0]);
+		if (peaksNum == 0) {
+			// nothing to lock to: plain phase vocoder
+			for (int i = 0; i <= m_N2; ++i) {
+				m_psi[i] = m_oldSynPhi[i] + (T) m_hop * m_phaseInc[i];
+			}
+		} else {
+			for (int i = 0; i < peaksNum; ++i) {
+				int pk = m_peaks[i];
+				m_psi[pk] = princarg<T> (m_oldSynPhi[pk] + (T) m_hop * m_phaseInc[pk]);
+			}
+			// bins around each peak keep their phase relation with it
+			int start = 0;
+			for (int i = 0; i < peaksNum; ++i) {
+				int pk = m_peaks[i];
+				int end = i < peaksNum - 1 ? (pk + m_peaks[i + 1]) / 2 : m_N2;
+				T rotation = m_psi[pk] - spectrum[2 * pk + 1];
+				for (int j = start; j <= end; ++j) {
+					if (j != pk) m_psi[j] = rotation + spectrum[2 * j + 1];
+				}
+				start = end + 1;
+			}
+		}
+		for (int i = 0; i <= m_N2; ++i) {
+			m_oldAnPhi[i] = spectrum[2 * i + 1];
+			m_oldSynPhi[i] = m_psi[i];
+			spectrum[2 * i + 1] = m_psi[i];
+		}
+	}
+	//! transposes by P and resynthesizes the windowed frame (N samples); work has N + 2 values
+	void synthesis (RealFFT<T>& fft, const T* spectrum, T P, T* frame, T* work) const {
+		memset (work, 0, (m_N + 2) * sizeof (T));
+		for (int k = 0; k <= m_N2; ++k) {
+			int pos = (int) ((T) k * P);
+			if (pos > m_N2) break;
+			if (spectrum[2 * k] > work[2 * pos]) {
+				work[2 * pos] = spectrum[2 * k];
+				work[2 * pos + 1] = spectrum[2 * k + 1];
+			}
+		}
+		pol2rect<T> (work, m_N2 + 1);
+		work[1] = work[2 * m_N2 + 1] = 0;
+		fft.inverse (work, frame);
+		fftshift<T> (frame, m_N);
+		T norm = 1. / m_N;
+		for (int i = 0; i < m_N; ++i) frame[i] *= m_window[i] * norm;
+	}
+	//! stretches and transposes len samples; the factors are sampled along the input
+	/*!
+	  stretch and transp hold ns and np values spread over the input (one value
+	  means constant); frames are centred on the analysis positions.
+	*/
+	void process (const T* in, long len, const T* stretch, int ns,
+		const T* transp, int np, std::vector<T>& out) {
+		reset ();
+		// frame schedule: analysis positions and transpositions
+		std::vector<long> pos;
+		std::vector<T> ptab;
+		double p = 0;
+		while (p < len) {
+			pos.push_back ((long) (p + .5));
+			ptab.push_back (sample (transp, np, p / len));
+			T s = sample (stretch, ns, p / len);
+			if (s < .01) s = .01;
+			p += m_hop / s;
+		}
+		long frames = (long) pos.size ();
+		long outlen = frames * m_hop;
+		std::vector<T> acc (outlen + m_N, 0);
+		std::vector<T> wsum (outlen + m_N, 0);
+
+		ThreadPool& pool = ThreadPool::instance ();
+		int chunks = pool.size ();
+		long batch = 16 * chunks;
+		int stride = m_N + 2;
+		std::vector<T> spectra (batch * stride);
+		std::vector<T> buffers (batch * m_N);
+		std::vector<RealFFT<T>*> ffts;
+		std::vector<std::vector<T> > works (chunks, std::vector<T> (stride));
+		for (int c = 0; c < chunks; ++c) ffts.push_back (new RealFFT<T> (m_N));
+		for (long b = 0; b < frames; b += batch) {
+			long count = frames - b < batch ? frames - b : batch;
+			int used = count < chunks ? (int) count : chunks;
+			pool.parallel_for (0, used, [&] (int c) {
+				for (long f = count * c / used; f < count * (c + 1) / used; ++f) {
+					T* frame = &buffers[f * m_N];
+					long start = pos[b + f] - m_N2;
+					for (int i = 0; i < m_N; ++i) {
+						long t = start + i;
+						frame[i] = t >= 0 && t < len ? in[t] : 0;
+					}
+					analysis (*ffts[c], frame, &spectra[f * stride]);
+				}
+			});
+			for (long f = 0; f < count; ++f) {
+				long g = b + f;
+				int D = g > 0 ? (int) (pos[g] - pos[g - 1]) : m_hop;
+				if (D < 1) D = 1;
+				propagate (&spectra[f * stride], D, ptab[g]);
+			}
+			pool.parallel_for (0, used, [&] (int c) {
+				for (long f = count * c / used; f < count * (c + 1) / used; ++f) {
+					synthesis (*ffts[c], &spectra[f * stride], ptab[b + f], &buffers[f * m_N], &works[c][0]);
+				}
+			});
+			for (long f = 0; f < count; ++f) {
+				long start = (b + f) * m_hop; // shifted by N / 2 (centred frames)
+				for (int i = 0; i < m_N; ++i) {
+					acc[start + i] += buffers[f * m_N + i];
+					wsum[start + i] += m_window[i] * m_window[i];
+				}
+			}
+		}
+		for (unsigned c = 0; c < ffts.size (); ++c) delete ffts[c];
+		// weighted overlap-add, scaled by the analysis/synthesis window product
+		out.resize (outlen);
+		for (long t = 0; t < outlen; ++t) {
+			T w = wsum[t + m_N2];
+			out[t] = w > 1e-9 ? acc[t + m_N2] / w : 0;
+		}
+	}
+private:
+	static T sample (const T* v, int n, double x) {
+		if (n <= 1) return v[0];
+		double p = x * (n - 1);
+		int i = (int) p;
+		if (i >= n - 1) return v[n - 1];
+		double frac = p - i;
+		return (T) ((1 - frac) * v[i] + frac * v[i + 1]);
+	}
+	int m_N;
+	int m_N2;
+	int m_hop;
+	std::vector<T> m_window;
+	std::vector<T> m_oldAnPhi;
+	std::vector<T> m_oldSynPhi;
+	std::vector<T> m_psi;
+	std::vector<T> m_phaseInc;
+	std::vector<int> m_peaks;
+};
+
+#endif	// PHASEVOCODER_H
+
+// EOF
@@ -0,0 +1,151 @@
+// Pitch.h
+//
+
+#ifndef PITCH_H
+#define PITCH_H
+
+#include "FFT.h"
+#include "SIMD.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cmath>
+
+//! d (tau) = e0 + e (tau) - 2 r (tau) for all the lags (the loop vectorizes)
+template <typename T>
+SIMD_CLONES void yin_difference (T e0, const T* energy, const T* corr, T* diff, int lags) {
+	for (int tau = 0; tau < lags; ++tau) {
+		diff[tau] = e0 + energy[tau] - 2 * corr[tau];
+	}
+}
+
+//! YIN fundamental frequency estimator
+/*!
+  The difference function of each frame is computed in O (N log N): the
+  autocorrelation term comes from the product of the spectra of the window and
+  of the whole frame, the energy terms from a running sum of squares. The
+  cumulative mean normalized difference is then searched for the first dip
+  below threshold (or its global minimum), refined by parabolic interpolation.
+  Confidence is 1 - d' at the chosen lag. Frames are centred every hop samples
+  and split over the thread pool.
+*/
+template <typename T>
+class YinTracker {
+private:
+	YinTracker& operator= (YinTracker&);
+	YinTracker (const YinTracker&);
+public:
+	YinTracker (T sr, T fmin, T fmax, int hop, T threshold) {
+		if (sr <= 0 || fmin <= 0 || fmax <= fmin || fmax >= sr / 2) {
+			throw std::runtime_error ("invalid frequency range requested for pitch tracking");
+		}
+		m_sr = sr;
+		m_hop = hop < 1 ? 1 : hop;
+		m_threshold = threshold;
+		m_minLag = (int) floor (sr / fmax);
+		if (m_minLag < 2) m_minLag = 2;
+		m_maxLag = (int) ceil (sr / fmin) + 1;
+		m_W = m_maxLag; // integration window: the longest period
+		m_L = m_W + m_maxLag;
+		m_fftSize = 8;
+		while (m_fftSize < m_L + m_W) m_fftSize <<= 1;
+	}
+	virtual ~YinTracker () {}
+	long frames (long len) const { return (len + m_hop - 1) / m_hop; }
+	void process (const T* in, long len, T* pitch, T* conf) const {
+		long count = frames (len);
+		ThreadPool& pool = ThreadPool::instance ();
+		int chunks = pool.size () * 4;
+		if (chunks > count) chunks = (int) count;
+		pool.parallel_for (0, chunks, [&] (int c) {
+			RealFFT<T> fft (m_fftSize);
+			Workspace w (m_fftSize, m_L, m_maxLag);
+			for (long f = count * c / chunks; f < count * (c + 1) / chunks; ++f) {
+				frame (fft, w, in, len, f * m_hop - m_L / 2, pitch[f], conf[f]);
+			}
+		});
+	}
+private:
+	struct Workspace {
+		Workspace (int fftSize, int L, int lags) :
+			x (fftSize), a (fftSize + 2), b (fftSize + 2), corr (fftSize),
+			squares (L + 1), energy (lags), diff (lags) {}
+		std::vector<T> x, a, b, corr, squares, energy, diff;
+	};
+	void frame (RealFFT<T>& fft, Workspace& w, const T* in, long len, long start,
+		T& pitch, T& conf) const {
+		// whole frame and window (the first W samples), zero padded
+		std::fill (w.x.begin (), w.x.end (), 0);
+		for (int i = 0; i < m_L; ++i) {
+			long t = start + i;
+			w.x[i] = t >= 0 && t < len ? in[t] : 0;
+		}
+		fft.forward (&w.x[0], &w.b[0]);
+		std::fill (w.x.begin () + m_W, w.x.end (), 0);
+		fft.forward (&w.x[0], &w.a[0]);
+		// r (tau) = sum x[j] x[j + tau]: inverse of conj (A) B
+		int bins = m_fftSize / 2 + 1;
+		for (int k = 0; k < bins; ++k) {
+			T ar = w.a[2 * k], ai = w.a[2 * k + 1];
+			T br = w.b[2 * k], bi = w.b[2 * k + 1];
+			w.a[2 * k] = ar * br + ai * bi;
+			w.a[2 * k + 1] = ar * bi - ai * br;
+		}
+		fft.inverse (&w.a[0], &w.corr[0]);
+		T norm = 1. / m_fftSize;
+		for (int tau = 0; tau < m_maxLag; ++tau) w.corr[tau] *= norm;
+
+		// energies of the windows starting at tau from a running sum of squares
+		w.squares[0] = 0;
+		for (int i = 0; i < m_L; ++i) {
+			long t = start + i;
+			T v = t >= 0 && t < len ? in[t] : 0;
+			w.squares[i + 1] = w.squares[i] + v * v;
+		}
+		for (int tau = 0; tau < m_maxLag; ++tau) {
+			w.energy[tau] = w.squares[tau + m_W] - w.squares[tau];
+		}
+		yin_difference (w.energy[0], &w.energy[0], &w.corr[0], &w.diff[0], m_maxLag);
+
+		// cumulative mean normalized difference
+		T sum = 0;
+		w.diff[0] = 1;
+		for (int tau = 1; tau < m_maxLag; ++tau) {
+			sum += w.diff[tau];
+			w.diff[tau] = sum > 0 ? w.diff[tau] * tau / sum : 1;
+		}
+		int best = -1;
+		for (int tau = m_minLag; tau < m_maxLag - 1; ++tau) {
+			if (w.diff[tau] < m_threshold) {
+				while (tau + 1 < m_maxLag - 1 && w.diff[tau + 1] < w.diff[tau]) ++tau;
+				best = tau;
+				break;
+			}
+		}
+		if (best < 0) {
+			best = m_minLag;
+			for (int tau = m_minLag; tau < m_maxLag - 1; ++tau) {
+				if (w.diff[tau] < w.diff[best]) best = tau;
+			}
+		}
+		T dmin;
+		T lag = best > 0 ? parabolicInterpolate<T> (best - 1, best, best + 1,
+			w.diff[best - 1], w.diff[best], w.diff[best + 1], &dmin) : best;
+		if (fabs (lag - best) > 1) lag = best;
+		pitch = m_sr / lag;
+		conf = 1 - w.diff[best];
+		if (conf < 0) conf = 0;
+	}
+	T m_sr;
+	int m_hop;
+	T m_threshold;
+	int m_minLag;
+	int m_maxLag;
+	int m_W;
+	int m_L;
+	int m_fftSize;
+};
+
+#endif	// PITCH_H
+
+// EOF
@@ -0,0 +1,170 @@
+// Reverb.h
+//
+
+#ifndef REVERB_H
+#define REVERB_H
+
+#include "FFT.h"
+#include "SIMD.h"
+
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+
+//! Feedback delay network reverb with two-band decay
+/*!
+  N delay lines are fed back through an orthogonal matrix: Hadamard (fast
+  transform, N log N adds) when N is a power of two, Householder
+  (I - 2/N 11', 2N operations) otherwise. Each line is followed by a one-pole
+  crossover whose low and high bands are scaled so that the sound decays by
+  60 dB in t60 seconds below the crossover and t60high above.
+  Since every line is at least as long as the block, a block of the line
+  outputs is read at once, processed sample by sample and written back: the
+  lines of a sample are stored side by side and handled LANES at a time with
+  SIMD (padding lines have zero gains). The two outputs take the lines with
+  different signs. The cost is linear in the length of the signal and the
+  memory is the delay lines plus one block.
+*/
+template <typename T>
+class FdnReverb {
+private:
+	FdnReverb& operator= (FdnReverb&);
+	FdnReverb (const FdnReverb&);
+	static const int LANES = 4;
+	static const int BLOCK = 256;
+public:
+	FdnReverb (T sr, const std::vector<int>& delays, T t60, T t60high, T crossover = 2000) {
+		if (delays.empty ()) throw std::runtime_error ("no delay lines requested for reverb");
+		if (t60 <= 0 || t60high <= 0) throw std::runtime_error ("invalid decay time requested for reverb");
+		m_N = (int) delays.size ();
+		m_width = (m_N + LANES - 1) / LANES * LANES;
+		m_hadamard = (m_N & (m_N - 1)) == 0;
+		m_block = BLOCK;
+		m_lines.resize (m_N);
+		m_pos.assign (m_N, 0);
+		for (int k = 0; k < m_N; ++k) {
+			if (delays[k] < 1) throw std::runtime_error ("invalid delay length requested for reverb");
+			m_lines[k].assign (delays[k], 0);
+			if (delays[k] < m_block) m_block = delays[k];
+		}
+		m_glow.assign (m_width, 0);
+		m_ghigh.assign (m_width, 0);
+		m_lp.assign (m_width, 0);
+		m_left.assign (m_width, 0);
+		m_right.assign (m_width, 0);
+		m_in.assign (m_width, 0);
+		T norm = 1. / sqrt ((T) m_N);
+		for (int k = 0; k < m_N; ++k) {
+			m_glow[k] = pow (10., -3. * delays[k] / (sr * t60));
+			m_ghigh[k] = pow (10., -3. * delays[k] / (sr * t60high));
+			m_left[k] = k % 2 ? -norm : norm;
+			m_right[k] = (k / 2) % 2 ? -norm : norm;
+			m_in[k] = norm;
+		}
+		m_coeff = 1 - exp (-TWOPI * crossover / sr);
+		m_rows.assign (m_block * m_width, 0);
+	}
+	virtual ~FdnReverb () {}
+	int lines () const { return m_N; }
+	bool hadamard () const { return m_hadamard; }
+	//! n samples of input, any n
+	void process (const T* in, T* left, T* right, long n) {
+		for (long t = 0; t < n; t += m_block) {
+			int b = (int) (n - t < m_block ? n - t : m_block);
+			block (in + t, left + t, right + t, b);
+		}
+	}
+private:
+	typedef typename SimdVec<T, LANES>::type V;
+	void block (const T* in, T* left, T* right, int n) {
+		// outputs of the lines, one row per sample
+		for (int k = 0; k < m_N; ++k) {
+			const std::vector<T>& line = m_lines[k];
+			int pos = m_pos[k], size = (int) line.size ();
+			for (int i = 0; i < n; ++i) {
+				m_rows[i * m_width + k] = line[pos];
+				if (++pos == size) pos = 0;
+			}
+		}
+		V c;
+		simd_set1 (c, m_coeff);
+		for (int i = 0; i < n; ++i) {
+			T* row = &m_rows[i * m_width];
+			T l = 0, r = 0;
+			for (int k = 0; k < m_width; k += LANES) {
+				V x, lp, gl, gh, y, tl, tr;
+				simd_load (x, row + k);
+				simd_load (lp, &m_lp[k]);
+				simd_load (gl, &m_glow[k]);
+				simd_load (gh, &m_ghigh[k]);
+				lp += c * (x - lp);
+				y = gl * lp + gh * (x - lp);
+				simd_store (&m_lp[k], lp);
+				simd_store (row + k, y);
+				simd_load (tl, &m_left[k]);
+				simd_load (tr, &m_right[k]);
+				tl *= y;
+				tr *= y;
+				for (int j = 0; j < LANES; ++j) {
+					l += tl[j];
+					r += tr[j];
+				}
+			}
+			left[i] = l;
+			right[i] = r;
+			mix (row);
+			T x = in[i];
+			for (int k = 0; k < m_width; k += LANES) {
+				V y, g;
+				simd_load (y, row + k);
+				simd_load (g, &m_in[k]);
+				y += g * x;
+				simd_store (row + k, y);
+			}
+		}
+		// new inputs of the lines, in the slots just read
+		for (int k = 0; k < m_N; ++k) {
+			std::vector<T>& line = m_lines[k];
+			int pos = m_pos[k], size = (int) line.size ();
+			for (int i = 0; i < n; ++i) {
+				line[pos] = m_rows[i * m_width + k];
+				if (++pos == size) pos = 0;
+			}
+			m_pos[k] = pos;
+		}
+	}
+	void mix (T* row) const {
+		if (m_hadamard) {
+			for (int h = 1; h < m_N; h *= 2) {
+				for (int i = 0; i < m_N; i += 2 * h) {
+					for (int j = i; j < i + h; ++j) {
+						T a = row[j], b = row[j + h];
+						row[j] = a + b;
+						row[j + h] = a - b;
+					}
+				}
+			}
+			T norm = 1. / sqrt ((T) m_N);
+			for (int k = 0; k < m_N; ++k) row[k] *= norm;
+		} else {
+			T sum = 0;
+			for (int k = 0; k < m_N; ++k) sum += row[k];
+			sum *= (T) 2 / m_N;
+			for (int k = 0; k < m_N; ++k) row[k] -= sum;
+		}
+	}
+	int m_N;
+	int m_width;
+	bool m_hadamard;
+	int m_block;
+	T m_coeff;
+	std::vector<std::vector<T> > m_lines;
+	std::vector<int> m_pos;
+	std::vector<T> m_glow, m_ghigh, m_lp;
+	std::vector<T> m_left, m_right, m_in;
+	std::vector<T> m_rows;
+};
+
+#endif	// REVERB_H
+
+// EOF
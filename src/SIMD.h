@@ -0,0 +1,96 @@
+// SIMD.h
+//
+
+#ifndef SIMD_H
+#define SIMD_H
+
+// kernels are written with the GCC/clang vector extensions, so the same code
+// maps to SSE2/AVX2 on x86 and NEON on ARM; on x86 the wider AVX2 variant is
+// selected at runtime (see simd_has_avx2)
+
+#if defined (__GNUC__)
+	#define SIMD_INLINE inline __attribute__((always_inline))
+#else
+	#define SIMD_INLINE inline
+#endif
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+	#define SIMD_X86
+	#define SIMD_TARGET_AVX2 __attribute__((target ("avx2,fma")))
+#else
+	#define SIMD_TARGET_AVX2
+#endif
+
+// compiles a function twice (default and AVX2) and picks one when loaded;
+// needs ifunc support from the loader, so only on x86 linux
+#if defined (SIMD_X86) && defined (__linux__) && !defined (__clang__)
+	#define SIMD_CLONES __attribute__((target_clones ("avx2", "default")))
+#else
+	#define SIMD_CLONES
+#endif
+
+//! Vector of W elements of type T
+template <typename T, int W>
+struct SimdVec {
+	typedef T type __attribute__((vector_size (W * sizeof (T))));
+};
+
+template <typename V, typename T>
+SIMD_INLINE void simd_load (V& v, const T* p) {
+	__builtin_memcpy (&v, p, sizeof (V));
+}
+
+template <typename V, typename T>
+SIMD_INLINE void simd_store (T* p, const V& v) {
+	__builtin_memcpy (p, &v, sizeof (V));
+}
+
+template <typename V, typename T>
+SIMD_INLINE void simd_set1 (V& v, T x) {
+	for (unsigned i = 0; i < sizeof (V) / sizeof (T); ++i) v[i] = x;
+}
+
+inline bool simd_has_avx2 () {
+#if defined (SIMD_X86)
+	static bool avx2 = __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+	return avx2;
+#else
+	return false;
+#endif
+}
+
+//! Flushes denormals to zero in the calling thread while in scope
+/*!
+  Recursive filters decaying towards zero spend most of their time on
+  denormal numbers, which are very slow on most CPUs; with FTZ and DAZ (x86)
+  or FZ (ARM) they become zero. The previous mode is restored on exit.
+*/
+class DenormalGuard {
+private:
+	DenormalGuard& operator= (DenormalGuard&);
+	DenormalGuard (const DenormalGuard&);
+public:
+#if defined (SIMD_X86) && defined (__SSE__)
+	DenormalGuard () {
+		m_mode = __builtin_ia32_stmxcsr ();
+		__builtin_ia32_ldmxcsr (m_mode | 0x8040); // FTZ | DAZ
+	}
+	~DenormalGuard () { __builtin_ia32_ldmxcsr (m_mode); }
+private:
+	unsigned m_mode;
+#elif defined (__GNUC__) && defined (__aarch64__)
+	DenormalGuard () {
+		m_mode = __builtin_aarch64_get_fpcr ();
+		__builtin_aarch64_set_fpcr (m_mode | (1 << 24)); // FZ
+	}
+	~DenormalGuard () { __builtin_aarch64_set_fpcr (m_mode); }
+private:
+	unsigned m_mode;
+#else
+	DenormalGuard () {}
+#endif
+};
+
+#endif	// SIMD_H
+
+// EOF
@@ -0,0 +1,201 @@
+// Score.h
+//
+
+#ifndef SCORE_H
+#define SCORE_H
+
+#include "Graph.h"
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+//! Sound of an event, produced a block at a time
+template <typename T>
+class Voice {
+public:
+	virtual ~Voice () {}
+	//! the next n samples
+	virtual void process (T* out, int n) = 0;
+};
+
+//! Voice playing samples rendered beforehand (silence after the end)
+template <typename T>
+class ArrayVoice : public Voice<T> {
+public:
+	ArrayVoice (const T* data, long len) : m_data (data, data + len) { m_pos = 0; }
+	void process (T* out, int n) {
+		int i = 0;
+		for (; i < n && m_pos < (long) m_data.size (); ++i) out[i] = m_data[m_pos++];
+		for (; i < n; ++i) out[i] = 0;
+	}
+private:
+	std::vector<T> m_data;
+	long m_pos;
+};
+
+//! Voice streaming one node of a graph (the graph is not owned)
+/*!
+  The graph is reset before the first block of the voice, so every event (and
+  every render of the score) plays it from the start; a voice ending in the
+  same block still gets its last samples first. A graph cannot feed two voices
+  at once.
+*/
+template <typename T>
+class GraphVoice : public Voice<T> {
+public:
+	GraphVoice (Graph<T>* g, int output) {
+		m_graph = g;
+		m_output = output;
+		m_started = false;
+	}
+	void process (T* out, int n) {
+		if (!m_started) {
+			m_graph->prepare (std::vector<int> (1, m_output));
+			m_graph->reset ();
+			m_started = true;
+		}
+		int block = m_graph->maxBlock ();
+		for (int t = 0; t < n; t += block) {
+			int k = n - t < block ? n - t : block;
+			m_graph->process (k);
+			const T* y = m_graph->output (m_output);
+			for (int i = 0; i < k; ++i) out[t + i] = y[i];
+		}
+	}
+private:
+	Graph<T>* m_graph;
+	int m_output;
+	bool m_started;
+};
+
+//! Timeline of events rendered a block at a time
+/*!
+  Every event has a start and a duration (in samples) and a function making
+  its voice, called when the event starts; the voice is deleted when the
+  event ends. Events are kept sorted by start, so each block only looks at
+  the events starting in it and at the active ones, and adds their samples
+  in place at the exact offset of their start. The memory used depends on
+  the number of voices sounding together, not on the length of the score.
+  Events can name the resource their voice uses (a graph), so that events
+  sharing it are kept from overlapping.
+*/
+template <typename T>
+class Score {
+private:
+	Score& operator= (Score&);
+	Score (const Score&);
+public:
+	typedef std::function<Voice<T>* ()> VoiceMaker;
+	Score (int maxBlock) {
+		m_maxBlock = maxBlock < 1 ? 1 : maxBlock;
+		m_buffer.resize (m_maxBlock);
+		m_sorted = true;
+		m_next = 0;
+		m_time = 0;
+		m_peak = 0;
+	}
+	virtual ~Score () { stop (); }
+	int maxBlock () const { return m_maxBlock; }
+	int events () const { return (int) m_events.size (); }
+	//! end of the last event
+	long length () const {
+		long len = 0;
+		for (unsigned i = 0; i < m_events.size (); ++i) {
+			if (m_events[i].start + m_events[i].duration > len) len = m_events[i].start + m_events[i].duration;
+		}
+		return len;
+	}
+	//! most voices sounding together since the last rewind
+	int peakVoices () const { return m_peak; }
+	//! true if an event using resource sounds within [start, start + duration)
+	bool overlaps (long start, long duration, const void* resource) const {
+		if (!resource || duration <= 0) return false;
+		for (unsigned i = 0; i < m_events.size (); ++i) {
+			const Event& e = m_events[i];
+			if (e.resource == resource && e.start < start + duration && start < e.start + e.duration) return true;
+		}
+		return false;
+	}
+	void add (long start, long duration, VoiceMaker make, const void* resource = nullptr) {
+		Event e;
+		e.start = start < 0 ? 0 : start;
+		e.duration = duration < 0 ? 0 : duration;
+		e.make = make;
+		e.resource = resource;
+		if (overlaps (e.start, e.duration, resource)) throw std::runtime_error ("overlapping events on the same resource in score");
+		if (!m_events.empty () && e.start < m_events.back ().start) m_sorted = false;
+		m_events.push_back (e);
+	}
+	//! back to time 0, dropping the active voices
+	void rewind () {
+		stop ();
+		if (!m_sorted) {
+			std::stable_sort (m_events.begin (), m_events.end (),
+				[] (const Event& a, const Event& b) { return a.start < b.start; });
+			m_sorted = true;
+		}
+		m_next = 0;
+		m_time = 0;
+		m_peak = 0;
+	}
+	//! the next n (at most maxBlock) samples of the sum of the events
+	void process (T* out, int n) {
+		if (!m_sorted) rewind ();
+		for (int i = 0; i < n; ++i) out[i] = 0;
+		long end = m_time + n;
+		while (m_next < m_events.size () && m_events[m_next].start < end) {
+			const Event& e = m_events[m_next++];
+			if (e.duration == 0) continue;
+			Active a;
+			a.begin = e.start;
+			a.end = e.start + e.duration;
+			a.voice = e.make ();
+			m_active.push_back (a);
+		}
+		if ((int) m_active.size () > m_peak) m_peak = (int) m_active.size ();
+		unsigned kept = 0;
+		for (unsigned k = 0; k < m_active.size (); ++k) {
+			Active a = m_active[k];
+			long from = a.begin > m_time ? a.begin : m_time;
+			long to = a.end < end ? a.end : end;
+			int count = (int) (to - from);
+			a.voice->process (&m_buffer[0], count);
+			T* y = out + (from - m_time);
+			for (int i = 0; i < count; ++i) y[i] += m_buffer[i];
+			if (a.end <= end) delete a.voice;
+			else m_active[kept++] = a;
+		}
+		m_active.resize (kept);
+		m_time = end;
+	}
+private:
+	struct Event {
+		long start;
+		long duration;
+		VoiceMaker make;
+		const void* resource;
+	};
+	struct Active {
+		long begin;
+		long end;
+		Voice<T>* voice;
+	};
+	void stop () {
+		for (unsigned k = 0; k < m_active.size (); ++k) delete m_active[k].voice;
+		m_active.clear ();
+	}
+	int m_maxBlock;
+	std::vector<Event> m_events;
+	std::vector<Active> m_active;
+	std::vector<T> m_buffer;
+	bool m_sorted;
+	unsigned m_next;
+	long m_time;
+	int m_peak;
+};
+
+#endif	// SCORE_H
+
+// EOF
@@ -0,0 +1,124 @@
+// ThreadPool.h
+//
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+
+//! Fixed pool of workers used to spread independent jobs over the cores
+/*!
+  parallel_for blocks until all the indices in [begin, end) have been processed;
+  the calling thread takes part in the work. Calls issued from inside a job run
+  serially on the current thread, so nested engines never deadlock the pool.
+  The number of workers can be forced with the QUILE_THREADS environment variable.
+*/
+class ThreadPool {
+private:
+	ThreadPool& operator= (ThreadPool&);
+	ThreadPool (const ThreadPool&);
+public:
+	ThreadPool (int threads = 0) {
+		if (threads <= 0) threads = default_size ();
+		m_stop = false;
+		m_job = nullptr;
+		m_generation = 0;
+		m_pending = 0;
+		for (int i = 0; i < threads - 1; ++i) {
+			m_workers.push_back (std::thread (&ThreadPool::loop, this));
+		}
+	}
+	virtual ~ThreadPool () {
+		{
+			std::unique_lock<std::mutex> lock (m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all ();
+		for (unsigned i = 0; i < m_workers.size (); ++i) m_workers[i].join ();
+	}
+	int size () const { return (int) m_workers.size () + 1; }
+	template <typename F>
+	void parallel_for (int begin, int end, F f, int grain = 1) {
+		if (end <= begin) return;
+		if (grain < 1) grain = 1;
+		if (m_workers.size () == 0 || in_job () || end - begin <= grain) {
+			for (int i = begin; i < end; ++i) f (i);
+			return;
+		}
+		std::unique_lock<std::mutex> call (m_call); // one parallel region at a time
+		std::atomic<int> next (begin);
+		std::function<void ()> job = [&] () {
+			int i;
+			while ((i = next.fetch_add (grain)) < end) {
+				int last = i + grain < end ? i + grain : end;
+				for (; i < last; ++i) f (i);
+			}
+		};
+		{
+			std::unique_lock<std::mutex> lock (m_mutex);
+			m_job = &job;
+			m_pending = (int) m_workers.size ();
+			++m_generation;
+		}
+		m_wake.notify_all ();
+		in_job () = true;
+		job ();
+		in_job () = false;
+		std::unique_lock<std::mutex> lock (m_mutex);
+		m_done.wait (lock, [this] () { return m_pending == 0; });
+		m_job = nullptr;
+	}
+	static ThreadPool& instance () {
+		static ThreadPool pool;
+		return pool;
+	}
+	static int default_size () {
+		const char* env = getenv ("QUILE_THREADS");
+		int n = env ? atoi (env) : 0;
+		if (n <= 0) n = (int) std::thread::hardware_concurrency ();
+		return n <= 0 ? 1 : n;
+	}
+private:
+	static bool& in_job () {
+		static thread_local bool flag = false;
+		return flag;
+	}
+	void loop () {
+		unsigned long seen = 0;
+		in_job () = true;
+		while (true) {
+			std::function<void ()>* job = nullptr;
+			{
+				std::unique_lock<std::mutex> lock (m_mutex);
+				m_wake.wait (lock, [&] () { return m_stop || m_generation != seen; });
+				if (m_stop) return;
+				seen = m_generation;
+				job = m_job;
+			}
+			(*job) ();
+			{
+				std::unique_lock<std::mutex> lock (m_mutex);
+				if (--m_pending == 0) m_done.notify_all ();
+			}
+		}
+	}
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::mutex m_call;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	std::function<void ()>* m_job;
+	unsigned long m_generation;
+	int m_pending;
+	bool m_stop;
+};
+
+#endif	// THREADPOOL_H
+
+// EOF
@@ -0,0 +1,189 @@
+// Units.h
+//
+
+#ifndef UNITS_H
+#define UNITS_H
+
+#include "PartConv.h"
+#include "Wavetable.h"
+#include "BPF.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+//! Stateful processor rendered one block at a time
+/*!
+  Units keep their state (phase, filter memory, position, pending output)
+  between calls to process, so that a long sound can be rendered in blocks of
+  any size with the same result as in one call; reset brings that state back
+  to the one after construction.
+*/
+template <typename T>
+class Unit {
+public:
+	virtual ~Unit () {}
+	//! n output samples from n input samples (control or audio, depending on the unit)
+	virtual void process (const T* in, T* out, int n) = 0;
+	virtual void reset () = 0;
+};
+
+//! Table-lookup oscillator driven by a frequency signal
+/*!
+  Same recurrence as osc; with a wavetable the mip level is chosen at every
+  sample from the frequency.
+*/
+template <typename T>
+class Oscil : public Unit<T> {
+public:
+	//! table has size + 1 points (guard point, as made by gen)
+	Oscil (T sr, const T* table, int size, T phase = 0) {
+		m_table.assign (table, table + size + 1);
+		m_wavetable = nullptr;
+		init (sr, size, phase);
+	}
+	Oscil (T sr, const Wavetable<T>* w, T phase = 0) {
+		m_wavetable = w;
+		init (sr, w->size (), phase);
+	}
+	void process (const T* freqs, T* out, int n) {
+		T phi = m_phi;
+		for (int i = 0; i < n; ++i) {
+			const T* table = m_wavetable ? m_wavetable->table (m_wavetable->level (freqs[i], m_sr)) : &m_table[0];
+			int ip = (int) phi;
+			T frac = phi - ip;
+			out[i] = (1 - frac) * table[ip] + frac * table[ip + 1];
+			phi += freqs[i] * m_rfn;
+			if (phi >= m_size) phi -= m_size;
+			else if (phi < 0) phi += m_size;
+		}
+		m_phi = phi;
+	}
+	void reset () { m_phi = m_phase; }
+private:
+	void init (T sr, int size, T phase) {
+		m_sr = sr;
+		m_size = size;
+		m_rfn = (T) size / sr;
+		// phase in cycles
+		m_phase = (phase - floor (phase)) * size;
+		m_phi = m_phase;
+	}
+	std::vector<T> m_table;
+	const Wavetable<T>* m_wavetable;
+	T m_sr;
+	int m_size;
+	T m_rfn;
+	T m_phase;
+	T m_phi;
+};
+
+//! Two-pole resonator (same coefficients as reson)
+template <typename T>
+class Resonator : public Unit<T> {
+public:
+	Resonator (T sr, T freq, T tau) {
+		T om = 2 * M_PI * (freq / sr);
+		T radius = exp (-2. * M_PI * (1. / tau) / sr);
+		m_a1 = -2 * radius * cos (om);
+		m_a2 = radius * radius;
+		m_gain = radius * sin (om);
+		m_x1 = m_y1 = m_y2 = 0;
+	}
+	void process (const T* in, T* out, int n) {
+		T x1 = m_x1, y1 = m_y1, y2 = m_y2;
+		for (int i = 0; i < n; ++i) {
+			T v = m_gain * x1 - m_a1 * y1 - m_a2 * y2;
+			x1 = in[i];
+			y2 = y1;
+			y1 = v;
+			out[i] = v;
+		}
+		m_x1 = x1;
+		m_y1 = y1;
+		m_y2 = y2;
+	}
+	void reset () { m_x1 = m_y1 = m_y2 = 0; }
+private:
+	T m_a1, m_a2, m_gain;
+	T m_x1, m_y1, m_y2;
+};
+
+//! Cursor on a break-point function (same segments as bpf and curve)
+/*!
+  Every call returns the next n values, rendered directly from the segments;
+  after the last segment the final value is held. The input is ignored.
+*/
+template <typename T>
+class Envelope : public Unit<T> {
+public:
+	Envelope (T init) {
+		m_end = init;
+		m_pos = 0;
+	}
+	void add_segment (int len, T end, T curve = 0) {
+		m_bpf.add_segment (m_end, len, end, curve);
+		m_end = end;
+	}
+	void process (const T*, T* out, int n) {
+		if (m_bpf.segments ()) m_bpf.render (out, m_pos, n);
+		else for (int i = 0; i < n; ++i) out[i] = m_end;
+		m_pos += n;
+	}
+	void reset () { m_pos = 0; }
+private:
+	BPF<T> m_bpf;
+	T m_end;
+	long m_pos;
+};
+
+//! Partitioned convolution fed with blocks of any size
+/*!
+  Input is collected in blocks of blockSize samples for PartConv, so the
+  output is delayed by blockSize samples; mix adds the dry input (delayed
+  as well).
+*/
+template <typename T>
+class Convolver : public Unit<T> {
+public:
+	Convolver (const T* imp, int impSize, int blockSize, int maxBlockSize, T scale, T mix) :
+		m_conv (imp, impSize, blockSize, maxBlockSize, scale) {
+		m_bsize = blockSize;
+		m_mix = mix;
+		m_in.resize (blockSize, 0);
+		m_out.resize (blockSize, 0);
+		m_dry.resize (blockSize, 0);
+		m_pos = 0;
+	}
+	int latency () const { return m_bsize; }
+	void process (const T* in, T* out, int n) {
+		for (int i = 0; i < n; ++i) {
+			out[i] = m_out[m_pos] + m_mix * m_dry[m_pos];
+			m_in[m_pos] = in[i];
+			if (++m_pos == m_bsize) {
+				m_conv.process (&m_in[0], &m_out[0]);
+				m_dry.swap (m_in);
+				m_pos = 0;
+			}
+		}
+	}
+	void reset () {
+		m_conv.reset ();
+		std::fill (m_in.begin (), m_in.end (), 0);
+		std::fill (m_out.begin (), m_out.end (), 0);
+		std::fill (m_dry.begin (), m_dry.end (), 0);
+		m_pos = 0;
+	}
+private:
+	PartConv<T> m_conv;
+	int m_bsize;
+	T m_mix;
+	std::vector<T> m_in;
+	std::vector<T> m_out;
+	std::vector<T> m_dry;
+	int m_pos;
+};
+
+#endif	// UNITS_H
+
+// EOF
@@ -0,0 +1,78 @@
+// Wavetable.h
+//
+
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include "FFT.h"
+
+#include <vector>
+#include <map>
+#include <cmath>
+
+//! Band-limited wavetable with one mip level per octave
+/*!
+  The harmonics are weighted as by gen (coefficient j is the amplitude of
+  harmonic j + 1, the sum is divided by the number of coefficients). Level l
+  keeps the first K / 2^l harmonics, K being the highest harmonic that fits
+  in the table, and is built with one inverse real FFT. Each level has size + 1
+  points (guard point). For a frequency f, level (f, sr) returns the first
+  level whose highest harmonic stays below Nyquist, so reading it does not
+  alias.
+*/
+template <typename T>
+class Wavetable {
+private:
+	Wavetable& operator= (Wavetable&);
+	Wavetable (const Wavetable&);
+public:
+	Wavetable (const std::vector<T>& coeffs, int size) {
+		if (size < 8 || (size & (size - 1))) throw std::runtime_error ("invalid size requested for wavetable");
+		if (coeffs.empty ()) throw std::runtime_error ("no harmonics requested for wavetable");
+		m_size = size;
+		int K = (int) coeffs.size ();
+		if (K > size / 2 - 1) K = size / 2 - 1;
+		for (int h = K; h >= 1; h /= 2) m_harmonics.push_back (h);
+		RealFFT<T> fft (size);
+		std::vector<T> spectrum (size + 2);
+		T norm = (T) .5 / coeffs.size ();
+		m_levels.resize (m_harmonics.size ());
+		for (unsigned l = 0; l < m_harmonics.size (); ++l) {
+			// c sin (2 pi h n / N) has bin h equal to -i c N / 2; the inverse is unnormalized
+			std::fill (spectrum.begin (), spectrum.end (), 0);
+			for (int h = 1; h <= m_harmonics[l]; ++h) spectrum[2 * h + 1] = -coeffs[h - 1] * norm;
+			m_levels[l].resize (size + 1);
+			fft.inverse (&spectrum[0], &m_levels[l][0]);
+			m_levels[l][size] = m_levels[l][0];
+		}
+	}
+	virtual ~Wavetable () {}
+	int size () const { return m_size; }
+	int levels () const { return (int) m_levels.size (); }
+	int harmonics (int l) const { return m_harmonics[l]; }
+	const T* table (int l) const { return &m_levels[l][0]; }
+	int level (T freq, T sr) const {
+		T f = fabs (freq);
+		int l = 0;
+		while (l < (int) m_levels.size () - 1 && m_harmonics[l] * f >= sr / 2) ++l;
+		return l;
+	}
+	//! shared instance for the given harmonics and size, built on first use
+	static Wavetable* cached (const std::vector<T>& coeffs, int size) {
+		static std::map<std::pair<int, std::vector<T> >, Wavetable*> cache;
+		std::pair<int, std::vector<T> > key (size, coeffs);
+		typename std::map<std::pair<int, std::vector<T> >, Wavetable*>::iterator it = cache.find (key);
+		if (it != cache.end ()) return it->second;
+		Wavetable* w = new Wavetable (coeffs, size);
+		cache[key] = w;
+		return w;
+	}
+private:
+	int m_size;
+	std::vector<int> m_harmonics;
+	std::vector<std::vector<T> > m_levels;
+};
+
+#endif	// WAVETABLE_H
+
+// EOF
@@ -33,11 +33,10 @@
 // rt playback
 // load db
 // granular orchestration
-// features + pitch + onsets
 // clustering
 // maple
 // orchidea
-// sparkle / blockconv / pvoc
+// sparkle
 // soundtypes (?)
 // nebula
 // nn (?)
@@ -53,6 +52,7 @@ struct Atom;
 typedef std::shared_ptr<Atom> AtomPtr;
 typedef double Real;
 typedef AtomPtr (*Builtin) (AtomPtr, AtomPtr);
+typedef void (*Deleter) (void*);
 enum AtomType {ARRAY, SYMBOL, STRING, LIST, STREAM, PROC, BUILTIN, OBJECT};
 const char* TYPE_NAMES[] = {"array", "symbol", "string", "list", "stream", "proc", "builtin", "object"};
 struct Atom {
@@ -61,8 +61,11 @@ private:
 	struct _constructor_tag { explicit _constructor_tag() = default; }; 
 public:	
 	Atom (_constructor_tag) {
-		 token = ""; func = nullptr; 
+		 token = ""; func = nullptr; obj = nullptr; deleter = nullptr;
 	}	
+	~Atom () {
+		if (deleter) deleter (obj); // objects owned by the atom
+	}
 	AtomType type;
 	std::string token;
 	std::deque<AtomPtr> sequence;
@@ -70,6 +73,7 @@ public:
 	Builtin func;
 	int minargs;
 	void* obj;
+	Deleter deleter;
 	static AtomPtr make_sequence (bool is_stream = false) { 
 		AtomPtr l = std::make_shared<Atom> (_constructor_tag{}); 
 		l->type = is_stream ? AtomType::STREAM : AtomType::LIST;
@@ -120,10 +124,11 @@ public:
 		s->minargs = min;
 		return s;	
 	}
-	static AtomPtr make_object (const std::string& type, void * o, AtomPtr cb) { 
+	static AtomPtr make_object (const std::string& type, void * o, AtomPtr cb, Deleter d = nullptr) { 
 		AtomPtr p = std::make_shared<Atom> (_constructor_tag{}); 
 		p->type = AtomType::OBJECT;
 		p->obj = o; p->token = type; p->sequence.push_back (cb);
+		p->deleter = d;
 		return p;
 	}	
 };
@@ -7,11 +7,29 @@
 #include "BPF.h"
 #include "WavFile.h"
 #include "FFT.h"
+#include "BlockConv.h"
+#include "PartConv.h"
+#include "PhaseVocoder.h"
+#include "Partials.h"
+#include "Features.h"
+#include "Pitch.h"
+#include "Onsets.h"
+#include "OscBank.h"
+#include "AddSynth.h"
+#include "Wavetable.h"
+#include "Units.h"
+#include "Graph.h"
+#include "Granular.h"
+#include "Score.h"
+#include "Mix.h"
+#include "Filterbank.h"
+#include "Reverb.h"
 
 #include "core.h"
 
 #include <vector>
 #include <valarray>
+#include <chrono>
 
 // SUPPORT  -----------------------------------------------------------------------
 void gen10 (const std::valarray<Real>& coeff, std::valarray<Real>& values) {
@@ -60,41 +78,155 @@ void deinterleave (const T* stereo, T* l, T* r, int n) {
 		r[i] = stereo[2 * i + 1];
 	}
 }	
+template <typename T>
+void direct_conv (const T* X, const T* Y, T* Z, int lenx, int leny, T scale) {
+	const T *xp, *yp;
+	T s;
+	int i, n, n_lo, n_hi;
+	int lenz = lenx + leny - 1;
+
+	for (i = 0; i < lenz; i++) {
+		s = 0.0;
+		n_lo = 0 > (i - leny + 1) ? 0 : i - leny + 1;
+		n_hi = lenx - 1 < i ? lenx - 1 : i;
+		xp = X + n_lo;
+		yp = Y + i - n_lo;
+		for (n = n_lo; n <= n_hi; n++) {
+			s += *xp * *yp;
+			xp++;
+			yp--;
+		}
+		Z[i] = s * scale;
+	}
+}
+//! Cost model used by conv to choose its strategy (seconds per unit of work)
+struct ConvCostModel {
+	double direct; // time-domain multiply-add
+	double fft;    // N log2 N of a complex transform
+	double mac;    // complex multiply-add in the frequency domain
+} conv_model = {1.1e-9, 1.2e-9, 1.5e-9};
+enum ConvStrategy {CONV_DIRECT, CONV_FFT, CONV_PARTITIONED};
+const char* CONV_STRATEGIES[] = {"direct", "fft", "partitioned"};
+//! Description of the last convolution, reported by convinfo
+struct ConvInfo {
+	std::string strategy;
+	std::vector<int> sizes;   // transform or partition sizes
+	std::vector<int> offsets; // partition offsets in the impulse response
+	long blocks;
+	double mean_cost;         // seconds per block
+	double max_cost;
+	double estimates[3];      // predicted seconds for each ConvStrategy
+} conv_info;
+//! Predicted costs of convolving M (short) with L (long) samples; returns the cheapest strategy
+ConvStrategy conv_estimate (long M, long L, double* estimates, int& bsize) {
+	double nlogn;
+	estimates[CONV_DIRECT] = conv_model.direct * M * L;
+	long N = (long) next_pow2 (L) << 1;
+	nlogn = N * log2 ((double) N);
+	estimates[CONV_FFT] = conv_model.fft * 3 * nlogn + conv_model.mac * N;
+	// overlap-save with the short input as impulse response, best block size
+	estimates[CONV_PARTITIONED] = -1;
+	for (long B = 64; B <= N / 2; B <<= 1) {
+		long parts = (M + B - 1) / B;
+		long blocks = (M + L - 1 + B - 1) / B;
+		nlogn = 2 * B * log2 (2. * B);
+		double c = conv_model.fft * 2 * nlogn + conv_model.mac * parts * 2 * B;
+		c *= blocks;
+		if (estimates[CONV_PARTITIONED] < 0 || c < estimates[CONV_PARTITIONED]) {
+			estimates[CONV_PARTITIONED] = c;
+			bsize = (int) B;
+		}
+	}
+	if (estimates[CONV_PARTITIONED] < 0) estimates[CONV_PARTITIONED] = estimates[CONV_FFT] * 2;
+	ConvStrategy best = CONV_DIRECT;
+	for (int i = 1; i < 3; ++i) if (estimates[i] < estimates[best]) best = (ConvStrategy) i;
+	return best;
+}
 // NUMERIC --------------------------------------------------------------------------------------
+// bpf v0 len v1 [len v2 ...]: lines, written directly into the result
 AtomPtr fn_bpf (AtomPtr node, AtomPtr env) {
-	Real init = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
-	int len  = (int) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
-	Real end = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array[0];
-	node->sequence.pop_front (); node->sequence.pop_front (); node->sequence.pop_front ();
-	if (node->sequence.size () % 2 != 0) error ("invalid number of arguments for bpf", node);
-	BPF<Real> bpf (len);
-	bpf.add_segment (init, len, end);
-	Real curr = end;
-	for (unsigned i = 0; i < node->sequence.size () / 2; ++i) {
-		int len  = (int) type_check (node->sequence.at (i * 2), AtomType::ARRAY, node)->array[0];
-		Real end = type_check (node->sequence.at (i * 2 + 1), AtomType::ARRAY, node)->array[0];
-		bpf.add_segment (curr, len, end);
+	if (node->sequence.size () % 2 != 1) error ("invalid number of arguments for bpf", node);
+	for (unsigned i = 0; i < node->sequence.size (); ++i) type_check (node->sequence.at (i), AtomType::ARRAY, node);
+	BPF<Real> bpf;
+	Real curr = node->sequence.at (0)->array[0];
+	for (unsigned i = 1; i < node->sequence.size (); i += 2) {
+		Real end = node->sequence.at (i + 1)->array[0];
+		bpf.add_segment (curr, (int) node->sequence.at (i)->array[0], end);
 		curr = end;
 	}
-	std::valarray<Real> out;
-	bpf.process (out);
-	return Atom::make_array (out);
+	AtomPtr out = Atom::make_array (0.);
+	out->array.resize (0);
+	bpf.process (out->array);
+	return out;
+}
+// curve v0 len v1 curve1 [len v2 curve2 ...]: exponential segments (0 is a line)
+AtomPtr fn_curve (AtomPtr node, AtomPtr env) {
+	if (node->sequence.size () % 3 != 1) error ("invalid number of arguments for curve", node);
+	for (unsigned i = 0; i < node->sequence.size (); ++i) type_check (node->sequence.at (i), AtomType::ARRAY, node);
+	BPF<Real> bpf;
+	Real curr = node->sequence.at (0)->array[0];
+	for (unsigned i = 1; i < node->sequence.size (); i += 3) {
+		Real end = node->sequence.at (i + 1)->array[0];
+		bpf.add_segment (curr, (int) node->sequence.at (i)->array[0], end, node->sequence.at (i + 2)->array[0]);
+		curr = end;
+	}
+	AtomPtr out = Atom::make_array (0.);
+	out->array.resize (0);
+	bpf.process (out->array);
+	return out;
 }
+// mix pos sig pos sig ... (mono), or mix [channels] {pos sig [gain] [pan]} ...
+// giving one array per channel (two channels if a pan is given)
 AtomPtr fn_mix (AtomPtr node, AtomPtr env) {
-	std::vector<Real> out;
-	if (node->sequence.size () % 2 != 0) error ("invalid number of arguments for mix", node);
-	for (unsigned i = 0; i < node->sequence.size () / 2; ++i) {
-		int p = (int) type_check (node->sequence.at (i * 2), AtomType::ARRAY, node)->array[0];
-		AtomPtr l = type_check (node->sequence.at (i * 2 + 1), AtomType::ARRAY, node);
-		int len = (int) (p + l->array.size ());
-		if (len > out.size ()) out.resize (len, 0);
-		// out[std::slice(p, len, 1)] += l->array;
-		for (unsigned t = 0; t < l->array.size (); ++t) {
-			out[t + p] += l->array[t];
+	Mixer<Real> mixer;
+	unsigned first = 0;
+	int channels = 1;
+	bool lists = node->sequence.at (node->sequence.size () - 1)->type == AtomType::LIST;
+	if (lists) {
+		if (node->sequence.at (0)->type == AtomType::ARRAY) {
+			channels = (int) node->sequence.at (0)->array[0];
+			if (channels < 1) error ("invalid number of channels in", node);
+			first = 1;
+		}
+		bool panned = false;
+		for (unsigned i = first; i < node->sequence.size (); ++i) {
+			AtomPtr in = type_check (node->sequence.at (i), AtomType::LIST, node);
+			if (in->sequence.size () < 2) error ("position and signal expected in", node);
+			long p = (long) type_check (in->sequence.at (0), AtomType::ARRAY, node)->array[0];
+			std::valarray<Real>& sig = type_check (in->sequence.at (1), AtomType::ARRAY, node)->array;
+			Real gain = 1, pan = 0;
+			if (in->sequence.size () > 2) gain = type_check (in->sequence.at (2), AtomType::ARRAY, node)->array[0];
+			if (in->sequence.size () > 3) {
+				pan = type_check (in->sequence.at (3), AtomType::ARRAY, node)->array[0];
+				panned = true;
+			}
+			if (p < 0) error ("negative position in", node);
+			mixer.add (p, sig.size () ? &sig[0] : nullptr, sig.size (), gain, pan);
+		}
+		if (first == 0 && panned) channels = 2;
+	} else {
+		if (node->sequence.size () % 2 != 0) error ("invalid number of arguments for mix", node);
+		for (unsigned i = 0; i < node->sequence.size () / 2; ++i) {
+			long p = (long) type_check (node->sequence.at (i * 2), AtomType::ARRAY, node)->array[0];
+			std::valarray<Real>& sig = type_check (node->sequence.at (i * 2 + 1), AtomType::ARRAY, node)->array;
+			if (p < 0) error ("negative position in", node);
+			mixer.add (p, sig.size () ? &sig[0] : nullptr, sig.size ());
 		}
 	}
-	std::valarray<Real> v (out.data(), out.size());
-	return Atom::make_array (v);
+	// output allocated once and accumulated in place
+	std::vector<AtomPtr> outs;
+	std::vector<Real*> ptrs;
+	for (int c = 0; c < channels; ++c) {
+		AtomPtr o = Atom::make_array (0.);
+		o->array.resize (mixer.length (), 0);
+		outs.push_back (o);
+		ptrs.push_back (mixer.length () ? &o->array[0] : nullptr);
+	}
+	if (mixer.length ()) mixer.process (&ptrs[0], channels, ThreadPool::instance ().size () > 1);
+	if (!lists || (channels == 1 && first == 0)) return outs[0];
+	AtomPtr l = Atom::make_sequence ();
+	for (int c = 0; c < channels; ++c) l->sequence.push_back (outs[c]);
+	return l;
 }
 AtomPtr fn_gen (AtomPtr node, AtomPtr env) {
 	int len = (int) type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
@@ -103,11 +235,42 @@ AtomPtr fn_gen (AtomPtr node, AtomPtr env) {
 	gen10 (coeffs, table);
 	return Atom::make_array (table);
 }
+// band-limited tables, shared by all the objects with the same harmonics
+AtomPtr fn_wavetable (AtomPtr node, AtomPtr env) {
+	std::valarray<Real>& coeffs = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array;
+	int size = 4096;
+	if (node->sequence.size () > 1) size = (int) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	if (!coeffs.size ()) error ("no harmonics given in", node);
+	if (size < 8 || (size & (size - 1))) error ("table size must be a power of two (at least 8) in", node);
+	std::vector<Real> c (std::begin (coeffs), std::end (coeffs));
+	return Atom::make_object ("wavetable", Wavetable<Real>::cached (c, size), Atom::make_sequence ());
+}
+// with a wavetable the mip level is chosen at every sample from the frequency
+void osc_wavetable (Real sr, const std::valarray<Real>& freqs, const Wavetable<Real>& w, std::valarray<Real>& out) {
+	int N = w.size ();
+	Real fn = (Real) sr / N; // Hz
+	Real phi = 0;
+	for (unsigned i = 0; i < freqs.size (); ++i) {
+		const Real* table = w.table (w.level (freqs[i], sr));
+		int intphi = (int) phi;
+		Real fracphi = phi - intphi;
+		out[i] = (1 - fracphi) * table[intphi] + fracphi * table[intphi + 1];
+		phi = phi + freqs[i] / fn;
+		if (phi >= N) phi = phi - N;
+		else if (phi < 0) phi = phi + N;
+	}
+}
 AtomPtr fn_osc (AtomPtr node, AtomPtr env) {
 	Real sr = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
 	std::valarray<Real> freqs = type_check (node->sequence.at (1), AtomType::ARRAY, node)->array;
-	std::valarray<Real> table = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array;
 	std::valarray<Real> out (freqs.size ());
+	if (node->sequence.at (2)->type == AtomType::OBJECT) {
+		AtomPtr w = node->sequence.at (2);
+		if (w->token != "wavetable") error ("wavetable expected in", node);
+		osc_wavetable (sr, freqs, *(Wavetable<Real>*) w->obj, out);
+		return Atom::make_array (out);
+	}
+	std::valarray<Real> table = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array;
 	int N = table.size () - 1;
 	Real fn = (Real) sr / N; // Hz
 	Real phi = 0; //rand () % (N - 1);
@@ -121,6 +284,83 @@ AtomPtr fn_osc (AtomPtr node, AtomPtr env) {
 	}
 	return Atom::make_array (out);
 }
+// amps and freqs are lists of envelopes, or partial-major matrices when the
+// number of partials is given
+AtomPtr fn_oscbank (AtomPtr node, AtomPtr env) {
+	Real sr = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	AtomPtr amps = node->sequence.at (1);
+	AtomPtr freqs = node->sequence.at (2);
+	std::valarray<Real>& table = type_check (node->sequence.at (3), AtomType::ARRAY, node)->array;
+	if (sr <= 0 || table.size () < 2) error ("invalid parameters for", node);
+	std::vector<const Real*> a, f;
+	long len = 0;
+	if (node->sequence.size () > 4) {
+		int partials = (int) type_check (node->sequence.at (4), AtomType::ARRAY, node)->array[0];
+		std::valarray<Real>& am = type_check (amps, AtomType::ARRAY, node)->array;
+		std::valarray<Real>& fm = type_check (freqs, AtomType::ARRAY, node)->array;
+		if (partials < 1 || am.size () != fm.size () || am.size () % partials != 0) {
+			error ("invalid matrices for", node);
+		}
+		len = am.size () / partials;
+		for (int p = 0; p < partials && len; ++p) {
+			a.push_back (&am[p * len]);
+			f.push_back (&fm[p * len]);
+		}
+	} else {
+		type_check (amps, AtomType::LIST, node);
+		type_check (freqs, AtomType::LIST, node);
+		if (amps->sequence.size () != freqs->sequence.size ()) error ("amps and freqs must have the same length in", node);
+		if (freqs->sequence.size ()) len = type_check (freqs->sequence.at (0), AtomType::ARRAY, node)->array.size ();
+		for (unsigned p = 0; p < freqs->sequence.size (); ++p) {
+			std::valarray<Real>& av = type_check (amps->sequence.at (p), AtomType::ARRAY, node)->array;
+			std::valarray<Real>& fv = type_check (freqs->sequence.at (p), AtomType::ARRAY, node)->array;
+			if ((long) av.size () != len || (long) fv.size () != len) error ("envelopes must have the same size in", node);
+			if (len) {
+				a.push_back (&av[0]);
+				f.push_back (&fv[0]);
+			}
+		}
+	}
+	std::valarray<Real> out (len);
+	if (a.size ()) {
+		OscBank<Real> bank (&table[0], table.size () - 1, sr);
+		bank.process (a, f, len, &out[0]);
+	}
+	return Atom::make_array (out);
+}
+// partials as returned by partials: {start-frame amps freqs}, one value every hop samples
+AtomPtr fn_addsyn (AtomPtr node, AtomPtr env) {
+	Real sr = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	AtomPtr partials = type_check (node->sequence.at (1), AtomType::LIST, node);
+	Real hop = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array[0];
+	int N = 512;
+	if (node->sequence.size () > 3) N = (int) type_check (node->sequence.at (3), AtomType::ARRAY, node)->array[0];
+	if (sr <= 0 || hop <= 0) error ("invalid parameters for", node);
+	if (N < 16 || (N & (N - 1))) error ("frame size must be a power of two (at least 16) in", node);
+	std::vector<SynthTrack<Real> > tracks;
+	long len = 0;
+	for (unsigned i = 0; i < partials->sequence.size (); ++i) {
+		AtomPtr p = type_check (partials->sequence.at (i), AtomType::LIST, node);
+		if (p->sequence.size () < 3) error ("invalid partial in", node);
+		SynthTrack<Real> tr;
+		tr.t0 = type_check (p->sequence.at (0), AtomType::ARRAY, node)->array[0] * hop;
+		std::valarray<Real>& amps = type_check (p->sequence.at (1), AtomType::ARRAY, node)->array;
+		std::valarray<Real>& freqs = type_check (p->sequence.at (2), AtomType::ARRAY, node)->array;
+		if (amps.size () != freqs.size ()) error ("amps and freqs must have the same size in", node);
+		if (!amps.size ()) continue;
+		tr.amps = &amps[0];
+		tr.freqs = &freqs[0];
+		tr.count = amps.size ();
+		long end = (long) (tr.t0 + (tr.count - 1) * hop) + 1;
+		if (end > len) len = end;
+		tracks.push_back (tr);
+	}
+	std::vector<Real> out;
+	AdditiveSynth<Real> synth (N, sr);
+	synth.process (tracks, hop, len, out);
+	std::valarray<Real> v (out.data (), out.size ());
+	return Atom::make_array (v);
+}
 AtomPtr fn_reson (AtomPtr node, AtomPtr env) {
 	AtomPtr in = type_check (node->sequence.at (0), AtomType::ARRAY, node);
 	Real sr = type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
@@ -151,6 +391,187 @@ AtomPtr fn_reson (AtomPtr node, AtomPtr env) {
 	}
 	return Atom::make_array (out);
 }
+// a parameter of filterbank: one value per filter (array) or one array per
+// filter (list), either given once for all the filters
+int filter_params (AtomPtr p, AtomPtr node) {
+	if (p->type == AtomType::LIST) return p->sequence.size ();
+	return type_check (p, AtomType::ARRAY, node)->array.size ();
+}
+void filter_param (AtomPtr p, unsigned k, const Real*& v, int& count, AtomPtr node) {
+	if (p->type == AtomType::LIST) {
+		std::valarray<Real>& a = type_check (p->sequence.at (p->sequence.size () == 1 ? 0 : k), AtomType::ARRAY, node)->array;
+		if (!a.size ()) error ("empty filter parameter in", node);
+		v = &a[0];
+		count = a.size ();
+	} else {
+		std::valarray<Real>& a = p->array;
+		v = &a[a.size () == 1 ? 0 : k];
+		count = 1;
+	}
+}
+// filterbank in sr freqs taus [amps] [len]: sum of resonators (as reson)
+// lasting by default the input plus the longest decay
+AtomPtr fn_filterbank (AtomPtr node, AtomPtr env) {
+	std::valarray<Real>& in = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array;
+	Real sr = type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	if (sr <= 0) error ("invalid sample rate in", node);
+	AtomPtr params[3];
+	params[0] = node->sequence.at (2);
+	params[1] = node->sequence.at (3);
+	params[2] = node->sequence.size () > 4 ? node->sequence.at (4) : Atom::make_array (1.);
+	int filters = filter_params (params[0], node);
+	for (int p = 1; p < 3; ++p) {
+		int c = filter_params (params[p], node);
+		if (c != filters && c != 1) error ("filter parameters must have one value or one per filter in", node);
+	}
+	if (!filters) error ("no filters given in", node);
+	std::vector<ResonatorTrack<Real> > tracks (filters);
+	Real longest = 0;
+	for (int k = 0; k < filters; ++k) {
+		ResonatorTrack<Real>& tr = tracks[k];
+		filter_param (params[0], k, tr.freqs, tr.nfreqs, node);
+		filter_param (params[1], k, tr.taus, tr.ntaus, node);
+		filter_param (params[2], k, tr.amps, tr.namps, node);
+		for (int i = 0; i < tr.ntaus; ++i) {
+			if (tr.taus[i] <= 0) error ("invalid decay time in", node);
+			if (tr.taus[i] > longest) longest = tr.taus[i];
+		}
+	}
+	long len = (long) in.size () + (long) (sr * longest);
+	if (node->sequence.size () > 5) len = (long) type_check (node->sequence.at (5), AtomType::ARRAY, node)->array[0];
+	if (len < 0) error ("invalid length in", node);
+	AtomPtr out = Atom::make_array (0.);
+	out->array.resize (len, 0);
+	ResonatorBank<Real> bank (sr, tracks);
+	if (len) bank.process (in.size () ? &in[0] : nullptr, in.size (), &out->array[0], len, ThreadPool::instance ().size () > 1);
+	return out;
+}
+// grain parameters are arrays with one value per grain (or a single value for
+// all): onsets, source positions and durations in samples, then pitch ratios,
+// amplitudes and pans; with pans the output is a stereo list
+AtomPtr fn_grains (AtomPtr node, AtomPtr env) {
+	std::valarray<Real>& src = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array;
+	const int PARAMS = 6;
+	std::valarray<Real>* params[PARAMS];
+	Real defaults[PARAMS] = {0, 0, 0, 1, 1, .5};
+	unsigned count = 0;
+	for (int k = 0; k < PARAMS; ++k) {
+		params[k] = nullptr;
+		if (node->sequence.size () > (unsigned) k + 1) {
+			params[k] = &type_check (node->sequence.at (k + 1), AtomType::ARRAY, node)->array;
+			if (params[k]->size () > count) count = params[k]->size ();
+		}
+	}
+	for (int k = 0; k < PARAMS; ++k) {
+		if (params[k] && params[k]->size () != count && params[k]->size () != 1) {
+			error ("grain parameters must have one value or one per grain in", node);
+		}
+	}
+	if (!src.size ()) error ("empty source in", node);
+	std::vector<Grain<Real> > grains (count);
+	for (unsigned i = 0; i < count; ++i) {
+		Real v[PARAMS];
+		for (int k = 0; k < PARAMS; ++k) {
+			v[k] = params[k] ? (*params[k])[params[k]->size () == 1 ? 0 : i] : defaults[k];
+		}
+		grains[i].onset = (long) v[0];
+		grains[i].position = v[1];
+		grains[i].duration = (long) v[2];
+		grains[i].pitch = v[3];
+		grains[i].amp = v[4];
+		grains[i].pan = v[5];
+		if (grains[i].onset < 0) error ("negative grain onset in", node);
+	}
+	bool stereo = node->sequence.size () > 6;
+	std::vector<Real> left, right;
+	GranularEngine<Real> engine (&src[0], src.size ());
+	engine.process (grains, stereo, ThreadPool::instance ().size () > 1, left, right);
+	std::valarray<Real> l (left.data (), left.size ());
+	if (!stereo) return Atom::make_array (l);
+	std::valarray<Real> r (right.data (), right.size ());
+	AtomPtr out = Atom::make_sequence ();
+	out->sequence.push_back (Atom::make_array (l));
+	out->sequence.push_back (Atom::make_array (r));
+	return out;
+}
+// stateful units: the object owns the unit, process advances it by one block
+void delete_unit (void* u) {
+	delete (Unit<Real>*) u;
+}
+AtomPtr fn_unit_process (AtomPtr node, AtomPtr env) {
+	Unit<Real>* u = (Unit<Real>*) node->sequence.at (0)->obj;
+	std::valarray<Real>& in = type_check (node->sequence.at (1), AtomType::ARRAY, node)->array;
+	std::valarray<Real> out (in.size ());
+	if (in.size ()) u->process (&in[0], &out[0], in.size ());
+	return Atom::make_array (out);
+}
+AtomPtr fn_envelope_process (AtomPtr node, AtomPtr env) {
+	Unit<Real>* u = (Unit<Real>*) node->sequence.at (0)->obj;
+	int n = (int) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	if (n < 0) error ("invalid block size in", node);
+	std::valarray<Real> out (n);
+	if (n) u->process (nullptr, &out[0], n);
+	return Atom::make_array (out);
+}
+AtomPtr fn_process (AtomPtr node, AtomPtr env) {
+	AtomPtr o = type_check (node->sequence.at (0), AtomType::OBJECT, node);
+	AtomPtr cb = o->sequence.at (0);
+	if (cb->type != AtomType::BUILTIN) error ("object cannot be processed in", node);
+	return cb->func (node, env);
+}
+AtomPtr fn_oscil (AtomPtr node, AtomPtr env) {
+	Real sr = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	AtomPtr table = node->sequence.at (1);
+	Real phase = 0;
+	if (node->sequence.size () > 2) phase = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array[0];
+	if (sr <= 0) error ("invalid sample rate in", node);
+	Unit<Real>* u = nullptr;
+	if (table->type == AtomType::OBJECT) {
+		if (table->token != "wavetable") error ("wavetable expected in", node);
+		u = new Oscil<Real> (sr, (Wavetable<Real>*) table->obj, phase);
+	} else {
+		std::valarray<Real>& t = type_check (table, AtomType::ARRAY, node)->array;
+		if (t.size () < 2) error ("invalid table in", node);
+		u = new Oscil<Real> (sr, &t[0], t.size () - 1, phase);
+	}
+	return Atom::make_object ("oscil", u, Atom::make_builtin (fn_unit_process), delete_unit);
+}
+AtomPtr fn_resonator (AtomPtr node, AtomPtr env) {
+	Real sr = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	Real freq = type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	Real tau = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array[0];
+	if (sr <= 0 || tau <= 0) error ("invalid parameters for", node);
+	return Atom::make_object ("resonator", new Resonator<Real> (sr, freq, tau),
+		Atom::make_builtin (fn_unit_process), delete_unit);
+}
+// the segments of bpf (stride 2) or curve (stride 3), sampled on demand
+template <int stride>
+AtomPtr fn_envelope (AtomPtr node, AtomPtr env) {
+	Real init = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	if (node->sequence.size () % stride != 1) error ("invalid number of arguments for envelope", node);
+	for (unsigned i = 1; i < node->sequence.size (); ++i) type_check (node->sequence.at (i), AtomType::ARRAY, node);
+	Envelope<Real>* e = new Envelope<Real> (init);
+	for (unsigned i = 1; i < node->sequence.size (); i += stride) {
+		e->add_segment ((int) node->sequence.at (i)->array[0], node->sequence.at (i + 1)->array[0],
+			stride == 3 ? node->sequence.at (i + 2)->array[0] : 0);
+	}
+	return Atom::make_object ("envelope", e, Atom::make_builtin (fn_envelope_process), delete_unit);
+}
+AtomPtr fn_convolver (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& ir = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	Real scale = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	Real mix = 0;
+	if (n->sequence.size () > 2) mix = type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	int bsize = 64;
+	if (n->sequence.size () > 3) bsize = (int) type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0];
+	int maxsize = 8192;
+	if (n->sequence.size () > 4) maxsize = (int) type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0];
+	if (ir.size () == 0 || bsize < 2 || maxsize < 2) error ("invalid lengths for convolver", n);
+	bsize = next_pow2 (bsize);
+	maxsize = next_pow2 (maxsize);
+	return Atom::make_object ("convolver", new Convolver<Real> (&ir[0], ir.size (), bsize, maxsize, scale, mix),
+		Atom::make_builtin (fn_unit_process), delete_unit);
+}
 template <int sign>
 AtomPtr fn_fft (AtomPtr n, AtomPtr env) {
 	int d = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array.size ();
@@ -173,42 +594,628 @@ AtomPtr fn_pol2car (AtomPtr n, AtomPtr env) {
 	pol2rect (&inout[0], inout.size () / 2);
 	return Atom::make_array (inout);
 }
+void stft_window (AtomPtr n, int arg, int N, std::valarray<Real>& window) {
+	window.resize (N);
+	if (n->sequence.size () > (unsigned) arg) {
+		std::valarray<Real>& w = type_check (n->sequence.at (arg), AtomType::ARRAY, n)->array;
+		if ((int) w.size () != N) error ("window must have the size of the frame in", n);
+		window = w;
+	} else hanningz (&window[0], N);
+}
+void stft_check (AtomPtr n, int N, int hop) {
+	if (N < 8 || (N & (N - 1))) error ("frame size must be a power of two (at least 8) in", n);
+	if (hop < 1 || hop > N) error ("invalid hop size in", n);
+}
+// frames start at (f + 1) * hop - N so that every sample is covered by N / hop
+// frames; the output is a frame-major matrix of N / 2 + 1 interleaved bins
+AtomPtr fn_stft (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& sig = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	int N = (int) type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	int hop = (int) type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	stft_check (n, N, hop);
+	std::valarray<Real> window;
+	stft_window (n, 3, N, window);
+	long len = sig.size ();
+	long frames = (len + hop - 1) / hop;
+	int stride = N + 2;
+	std::valarray<Real> out (frames * stride);
+
+	ThreadPool& pool = ThreadPool::instance ();
+	int chunks = pool.size () * 4;
+	if (chunks > frames) chunks = (int) frames;
+	pool.parallel_for (0, chunks, [&] (int c) {
+		RealFFT<Real> fft (N);
+		std::vector<Real> buff (N);
+		for (long f = frames * c / chunks; f < frames * (c + 1) / chunks; ++f) {
+			long start = (f + 1) * hop - N;
+			for (int i = 0; i < N; ++i) {
+				long t = start + i;
+				buff[i] = t >= 0 && t < len ? sig[t] * window[i] : 0;
+			}
+			fft.forward (&buff[0], &out[f * stride]);
+		}
+	});
+	return Atom::make_array (out);
+}
+// weighted overlap-add: each frame is windowed again and the sum is divided
+// by the sum of the squared windows, so any window/hop pair resynthesizes
+AtomPtr fn_istft (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& spec = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	int N = (int) type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	int hop = (int) type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	stft_check (n, N, hop);
+	std::valarray<Real> window;
+	stft_window (n, 3, N, window);
+	int stride = N + 2;
+	if (spec.size () % stride != 0) error ("spectrum size is not a multiple of the frame in", n);
+	long frames = spec.size () / stride;
+	long len = frames * hop;
+	if (n->sequence.size () > 4) {
+		len = (long) type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0];
+		if (len < 0 || len > frames * hop) error ("invalid length for", n);
+	}
+	std::valarray<Real> out (frames * hop + N);
+	std::valarray<Real> wsum (frames * hop + N);
+
+	// frames are resynthesized in parallel batches, then added serially
+	ThreadPool& pool = ThreadPool::instance ();
+	int chunks = pool.size ();
+	long batch = 16 * chunks;
+	std::valarray<Real> frame_buff (batch * N);
+	Real norm = 1. / N;
+	std::vector<RealFFT<Real>*> ffts;
+	for (int c = 0; c < chunks; ++c) ffts.push_back (new RealFFT<Real> (N));
+	for (long b = 0; b < frames; b += batch) {
+		long count = frames - b < batch ? frames - b : batch;
+		int used = count < chunks ? (int) count : chunks;
+		pool.parallel_for (0, used, [&] (int c) {
+			for (long f = count * c / used; f < count * (c + 1) / used; ++f) {
+				Real* y = &frame_buff[f * N];
+				ffts[c]->inverse (&spec[(b + f) * stride], y);
+				for (int i = 0; i < N; ++i) y[i] *= window[i] * norm;
+			}
+		});
+		for (long f = 0; f < count; ++f) {
+			long start = (b + f + 1) * hop; // shifted by N (the padding of stft)
+			for (int i = 0; i < N; ++i) {
+				out[start + i] += frame_buff[f * N + i];
+				wsum[start + i] += window[i] * window[i];
+			}
+		}
+	}
+	for (unsigned c = 0; c < ffts.size (); ++c) delete ffts[c];
+	std::valarray<Real> res (len);
+	for (long t = 0; t < len; ++t) {
+		Real w = wsum[t + N];
+		res[t] = w > 1e-9 ? out[t + N] / w : 0;
+	}
+	return Atom::make_array (res);
+}
+AtomPtr fn_pvoc (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& sig = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	std::valarray<Real>& stretch = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
+	std::valarray<Real>& transp = type_check (n->sequence.at (2), AtomType::ARRAY, n)->array;
+	int N = 2048;
+	int overlap = 4;
+	if (n->sequence.size () > 3) N = (int) type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0];
+	if (n->sequence.size () > 4) overlap = (int) type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0];
+	if (N < 8 || (N & (N - 1))) error ("frame size must be a power of two (at least 8) in", n);
+	if (overlap < 2 || overlap > N) error ("invalid overlap in", n);
+	if (sig.size () == 0 || stretch.size () == 0 || transp.size () == 0) error ("empty array in", n);
+	for (unsigned i = 0; i < stretch.size (); ++i) {
+		if (stretch[i] <= 0) error ("stretch factors must be positive in", n);
+	}
+	PhaseVocoder<Real> pv (N, overlap);
+	std::vector<Real> out;
+	pv.process (&sig[0], sig.size (), &stretch[0], stretch.size (), &transp[0], transp.size (), out);
+	std::valarray<Real> v (out.data (), out.size ());
+	return Atom::make_array (v);
+}
+AtomPtr fn_partials (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& sig = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	Real sr = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	Real params[] = {40, 2048, 512, -70, 50, 3}; // maxpeaks size hop threshold maxdelta minlength
+	for (unsigned i = 2; i < n->sequence.size () && i < 8; ++i) {
+		params[i - 2] = type_check (n->sequence.at (i), AtomType::ARRAY, n)->array[0];
+	}
+	int N = (int) params[1];
+	if (N < 8 || (N & (N - 1))) error ("frame size must be a power of two (at least 8) in", n);
+	if (sr <= 0 || params[0] < 1 || params[2] < 1) error ("invalid parameters for", n);
+	PartialTracker<Real> tracker (N, (int) params[2], sr, (int) params[0], params[3], params[4], (int) params[5]);
+	std::vector<Partial<Real> > partials;
+	tracker.process (&sig[0], sig.size (), partials);
+	AtomPtr l = Atom::make_sequence ();
+	for (unsigned i = 0; i < partials.size (); ++i) {
+		AtomPtr p = Atom::make_sequence ();
+		p->sequence.push_back (Atom::make_array (partials[i].start));
+		std::valarray<Real> amps (partials[i].amps.data (), partials[i].amps.size ());
+		std::valarray<Real> freqs (partials[i].freqs.data (), partials[i].freqs.size ());
+		p->sequence.push_back (Atom::make_array (amps));
+		p->sequence.push_back (Atom::make_array (freqs));
+		l->sequence.push_back (p);
+	}
+	return l;
+}
+const char* FEATURE_NAMES[] = {"rms", "centroid", "spread", "flux", "rolloff", "flatness", "zcr", "mfcc"};
+// frame-major matrix, one column per feature (mfcc gives MFCC_COEFFS columns)
+AtomPtr fn_features (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& sig = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	Real sr = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	std::vector<int> features;
+	if (n->sequence.size () > 2) {
+		AtomPtr names = n->sequence.at (2);
+		if (names->type != AtomType::LIST) {
+			AtomPtr l = Atom::make_sequence ();
+			l->sequence.push_back (names);
+			names = l;
+		}
+		for (unsigned i = 0; i < names->sequence.size (); ++i) {
+			AtomPtr name = names->sequence.at (i);
+			if (name->type != AtomType::SYMBOL && name->type != AtomType::STRING) {
+				error ("invalid feature name in", n);
+			}
+			int f = 0;
+			while (f < FEAT_COUNT && name->token != FEATURE_NAMES[f]) ++f;
+			if (f == FEAT_COUNT) error ("unknown feature " + name->token + " in", n);
+			features.push_back (f);
+		}
+	} else {
+		for (int f = 0; f < FEAT_COUNT; ++f) features.push_back (f);
+	}
+	int N = n->sequence.size () > 3 ? (int) type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0] : 2048;
+	int hop = n->sequence.size () > 4 ? (int) type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0] : 512;
+	if (N < 8 || (N & (N - 1))) error ("frame size must be a power of two (at least 8) in", n);
+	if (sr <= 0 || hop < 1) error ("invalid parameters for", n);
+	FeatureExtractor<Real> extractor (N, hop, sr, features);
+	std::vector<Real> out;
+	extractor.process (&sig[0], sig.size (), out);
+	std::valarray<Real> v (out.data (), out.size ());
+	return Atom::make_array (v);
+}
+// a list of signals gives a list of results, the signals being spread over the pool
+AtomPtr fn_pitch (AtomPtr n, AtomPtr env) {
+	AtomPtr sigs = n->sequence.at (0);
+	Real sr = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	Real params[] = {60, 1000, 512, .15}; // fmin fmax hop threshold
+	for (unsigned i = 2; i < n->sequence.size () && i < 6; ++i) {
+		params[i - 2] = type_check (n->sequence.at (i), AtomType::ARRAY, n)->array[0];
+	}
+	if (sr <= 0 || params[0] <= 0 || params[1] <= params[0] || params[1] >= sr / 2 || params[2] < 1) {
+		error ("invalid parameters for", n);
+	}
+	bool many = sigs->type == AtomType::LIST;
+	if (!many) {
+		AtomPtr l = Atom::make_sequence ();
+		l->sequence.push_back (sigs);
+		sigs = l;
+	}
+	int count = sigs->sequence.size ();
+	for (int i = 0; i < count; ++i) type_check (sigs->sequence.at (i), AtomType::ARRAY, n);
+	YinTracker<Real> yin (sr, params[0], params[1], (int) params[2], params[3]);
+	std::vector<std::valarray<Real> > pitches (count), confs (count);
+	ThreadPool::instance ().parallel_for (0, count, [&] (int i) {
+		std::valarray<Real>& sig = sigs->sequence.at (i)->array;
+		pitches[i].resize (yin.frames (sig.size ()));
+		confs[i].resize (yin.frames (sig.size ()));
+		if (sig.size ()) yin.process (&sig[0], sig.size (), &pitches[i][0], &confs[i][0]);
+	});
+	AtomPtr out = Atom::make_sequence ();
+	for (int i = 0; i < count; ++i) {
+		AtomPtr r = Atom::make_sequence ();
+		r->sequence.push_back (Atom::make_array (pitches[i]));
+		r->sequence.push_back (Atom::make_array (confs[i]));
+		out->sequence.push_back (r);
+	}
+	return many ? out : out->sequence.at (0);
+}
+const char* ONSET_METHODS[] = {"flux", "complex", "hfc"};
+// a file name is read in blocks, so files of any length can be segmented;
+// sr is only needed for arrays
+AtomPtr fn_onsets (AtomPtr n, AtomPtr env) {
+	AtomPtr input = n->sequence.at (0);
+	int method = ONSET_FLUX;
+	if (n->sequence.size () > 1) {
+		AtomPtr m = n->sequence.at (1);
+		if (m->type != AtomType::SYMBOL && m->type != AtomType::STRING) error ("invalid onset method in", n);
+		while (method < 3 && m->token != ONSET_METHODS[method]) ++method;
+		if (method == 3) error ("unknown onset method " + m->token + " in", n);
+	}
+	Real params[] = {1, .5, 1024, 256, 44100}; // lambda delta size hop sr
+	for (unsigned i = 2; i < n->sequence.size () && i < 7; ++i) {
+		params[i - 2] = type_check (n->sequence.at (i), AtomType::ARRAY, n)->array[0];
+	}
+	int N = (int) params[2];
+	int hop = (int) params[3];
+	if (N < 8 || (N & (N - 1))) error ("frame size must be a power of two (at least 8) in", n);
+	if (hop < 1 || hop > N || params[4] <= 0) error ("invalid parameters for", n);
+
+	std::vector<Real> onsets;
+	const Real gap = .05; // seconds
+	const int width = 10; // frames on each side for the threshold
+	if (input->type == AtomType::STRING) {
+		WavInFile infile (input->token.c_str ());
+		int channels = infile.getNumChannels ();
+		OnsetDetector<Real> detector (N, hop, infile.getSampleRate (), (OnsetMethod) method,
+			params[0], params[1], width, gap);
+		const int block = 65536;
+		std::vector<Real> buff (block * channels);
+		std::vector<Real> mono (block);
+		while (!infile.eof ()) {
+			int read = infile.read (&buff[0], block * channels) / channels;
+			if (read <= 0) break;
+			for (int i = 0; i < read; ++i) {
+				Real s = 0;
+				for (int c = 0; c < channels; ++c) s += buff[i * channels + c];
+				mono[i] = s / channels;
+			}
+			detector.process (&mono[0], read, onsets);
+		}
+		detector.flush (onsets);
+	} else {
+		std::valarray<Real>& sig = type_check (input, AtomType::ARRAY, n)->array;
+		OnsetDetector<Real> detector (N, hop, params[4], (OnsetMethod) method,
+			params[0], params[1], width, gap);
+		if (sig.size ()) detector.process (&sig[0], sig.size (), onsets);
+		detector.flush (onsets);
+	}
+	std::valarray<Real> v (onsets.data (), onsets.size ());
+	return Atom::make_array (v);
+}
+// r[k] = sum x[n + k] y[n] for k in ]-ly, lx[, stored at (k + N) % N; y null gives
+// the autocorrelation of x with a single forward transform
+int fft_correlate (const Real* x, int lx, const Real* y, int ly, std::vector<Real>& r) {
+	int N = 8;
+	while (N < lx + ly - 1) N <<= 1;
+	RealFFT<Real> fft (N);
+	std::vector<Real> buff (N, 0);
+	std::vector<Real> X (N + 2), Y (N + 2);
+	memcpy (&buff[0], x, lx * sizeof (Real));
+	fft.forward (&buff[0], &X[0]);
+	if (y) {
+		std::fill (buff.begin (), buff.end (), 0);
+		memcpy (&buff[0], y, ly * sizeof (Real));
+		fft.forward (&buff[0], &Y[0]);
+	} else Y = X;
+	for (int k = 0; k < N / 2 + 1; ++k) {
+		Real xr = X[2 * k], xi = X[2 * k + 1];
+		Real yr = Y[2 * k], yi = -Y[2 * k + 1];
+		X[2 * k] = (xr * yr - xi * yi) / N;
+		X[2 * k + 1] = (xr * yi + xi * yr) / N;
+	}
+	r.resize (N);
+	fft.inverse (&X[0], &r[0]);
+	return N;
+}
+AtomPtr fn_xcorr (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& x = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	std::valarray<Real>& y = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
+	int lx = x.size (), ly = y.size ();
+	if (!lx || !ly) error ("empty array in", n);
+	int maxlag = lx > ly ? lx - 1 : ly - 1;
+	if (n->sequence.size () > 2) {
+		maxlag = (int) type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+		if (maxlag < 0) error ("invalid maximum lag in", n);
+	}
+	bool peak = n->sequence.size () > 3 && type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0] != 0;
+	std::vector<Real> r;
+	int N = fft_correlate (&x[0], lx, &y[0], ly, r);
+	// lags from -maxlag to maxlag; out of range lags are zero
+	std::valarray<Real> out (2 * maxlag + 1);
+	int best = 0;
+	for (int k = -maxlag; k <= maxlag; ++k) {
+		if (k > -ly && k < lx) out[k + maxlag] = r[(k + N) % N];
+		if (out[k + maxlag] > out[best]) best = k + maxlag;
+	}
+	if (!peak) return Atom::make_array (out);
+	AtomPtr l = Atom::make_sequence ();
+	l->sequence.push_back (Atom::make_array (out));
+	l->sequence.push_back (Atom::make_array (best - maxlag));
+	return l;
+}
+// one-sided (lags 0 to maxlag); the peak skips the lobe around lag 0
+AtomPtr fn_autocorr (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& x = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	int lx = x.size ();
+	if (!lx) error ("empty array in", n);
+	int maxlag = lx - 1;
+	if (n->sequence.size () > 1) {
+		maxlag = (int) type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+		if (maxlag < 0) error ("invalid maximum lag in", n);
+	}
+	bool peak = n->sequence.size () > 2 && type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0] != 0;
+	std::vector<Real> r;
+	fft_correlate (&x[0], lx, nullptr, lx, r);
+	std::valarray<Real> out (maxlag + 1);
+	for (int k = 0; k <= maxlag && k < lx; ++k) out[k] = r[k];
+	if (!peak) return Atom::make_array (out);
+	int k = 1;
+	while (k <= maxlag && out[k] <= out[k - 1]) ++k;
+	int best = k <= maxlag ? k : 0;
+	for (; k <= maxlag; ++k) if (out[k] > out[best]) best = k;
+	AtomPtr l = Atom::make_sequence ();
+	l->sequence.push_back (Atom::make_array (out));
+	l->sequence.push_back (Atom::make_array (best));
+	return l;
+}
 AtomPtr fn_conv (AtomPtr n, AtomPtr env) {
-    std::valarray<Real> ir = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
-    std::valarray<Real> sig = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
-    Real scale = type_check(n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	std::valarray<Real>& ir = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	std::valarray<Real>& sig = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
+	Real scale = type_check(n->sequence.at (2), AtomType::ARRAY, n)->array[0];
 	Real mix = 0;
 	if (n->sequence.size () == 4) mix = type_check(n->sequence.at (3), AtomType::ARRAY, n)->array[0];
-    long irsamps = ir.size ();
-    long sigsamps = sig.size ();
-    if (irsamps <= 0 || sigsamps <= 0) error ("invalid lengths for conv", n);
-    int max = irsamps > sigsamps ? irsamps : sigsamps;
-    int N = next_pow2(max) << 1;
-	std::valarray<Real> fbuffir(2 * N);
-	std::valarray<Real> fbuffsig(2 * N);
-	std::valarray<Real> fbuffconv(2 * N);
-    for (unsigned i = 0; i < N; ++i) {
-        if (i < irsamps) fbuffir[2 * i] = ir[i];
-        else fbuffir[2 * i] = 0;
-        if (i < sigsamps) fbuffsig[2 * i] = sig[i];
-        else fbuffsig[2 * i] = 0;
-        fbuffconv[2 * i] = 0;
-        fbuffir[2 * i + 1] = 0;
-        fbuffsig[2 * i + 1] = 0;
-        fbuffconv[2 * i + 1] = 0;        
-    }
-    AbstractFFT<Real>* fft = createFFT<Real>(N);
-    fft->forward(&fbuffir[0]);
-    fft->forward(&fbuffsig[0]);
-    complexMultiplyReplace(&fbuffir[0], &fbuffsig[0], &fbuffconv[0], N);
-    fft->inverse(&fbuffconv[0]);
-	std::valarray<Real> out  (irsamps + sigsamps - 1);
-    for (unsigned i = 0; i < (irsamps + sigsamps) -1; ++i) {
-        Real s = scale * fbuffconv[2 * i] / N;
-        if (i < sigsamps) s+= sig[i] * mix;
-        out[i] = s;
-    }
-    return Atom::make_array (out);
+	long irsamps = ir.size ();
+	long sigsamps = sig.size ();
+	if (irsamps <= 0 || sigsamps <= 0) error ("invalid lengths for conv", n);
+	// convolution commutes: the shorter input plays the impulse response
+	std::valarray<Real>& h = irsamps <= sigsamps ? ir : sig;
+	std::valarray<Real>& x = irsamps <= sigsamps ? sig : ir;
+	long M = h.size ();
+	long L = x.size ();
+	int bsize = 0;
+	ConvStrategy strategy = conv_estimate (M, L, conv_info.estimates, bsize);
+	conv_info.strategy = CONV_STRATEGIES[strategy];
+	conv_info.sizes.clear ();
+	conv_info.offsets.clear ();
+	conv_info.blocks = 1;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+
+	std::valarray<Real> out (M + L - 1);
+	if (strategy == CONV_DIRECT) {
+		direct_conv (&h[0], &x[0], &out[0], M, L, scale);
+	} else if (strategy == CONV_FFT) {
+		int N = next_pow2 (L) << 1;
+		std::valarray<Real> fbuffir (2 * N);
+		std::valarray<Real> fbuffsig (2 * N);
+		for (long i = 0; i < M; ++i) fbuffir[2 * i] = h[i];
+		for (long i = 0; i < L; ++i) fbuffsig[2 * i] = x[i];
+		AbstractFFT<Real>* fft = createFFT<Real> (N);
+		fft->forward (&fbuffir[0]);
+		fft->forward (&fbuffsig[0]);
+		complexMultiplyReplace (&fbuffir[0], &fbuffsig[0], &fbuffir[0], N);
+		fft->inverse (&fbuffir[0]);
+		delete fft;
+		for (long i = 0; i < M + L - 1; ++i) out[i] = scale * fbuffir[2 * i] / N;
+		conv_info.sizes.push_back (N);
+	} else {
+		BlockConv<Real> conv (&h[0], nullptr, M, bsize, scale);
+		std::valarray<Real> in (bsize);
+		std::valarray<Real> block (bsize);
+		for (long p = 0; p < M + L - 1; p += bsize) {
+			for (long i = 0; i < bsize; ++i) in[i] = p + i < L ? x[p + i] : 0;
+			conv.process (&in[0], &block[0]);
+			for (long i = 0; i < bsize && p + i < M + L - 1; ++i) out[p + i] = block[i];
+		}
+		conv_info.sizes.push_back (bsize);
+		conv_info.offsets.push_back (0);
+		conv_info.blocks = (M + L - 1 + bsize - 1) / bsize;
+	}
+	if (mix != 0) {
+		for (long i = 0; i < sigsamps; ++i) out[i] += sig[i] * mix;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+	conv_info.mean_cost = elapsed.count () / conv_info.blocks;
+	conv_info.max_cost = conv_info.mean_cost;
+	return Atom::make_array (out);
+}
+AtomPtr fn_convcalibrate (AtomPtr n, AtomPtr env) {
+	const int N = 16384;
+	const int M = 64;
+	const int reps = 16;
+	std::valarray<Real> a (2 * N), b (2 * N), c (2 * N + M);
+	for (int i = 0; i < 2 * N; ++i) {
+		a[i] = ((Real) rand () / RAND_MAX) * 2. - 1;
+		b[i] = ((Real) rand () / RAND_MAX) * 2. - 1;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+	for (int r = 0; r < reps; ++r) direct_conv (&a[0], &b[0], &c[0], M, N, (Real) 1);
+	std::chrono::duration<double> t = std::chrono::steady_clock::now () - start;
+	conv_model.direct = t.count () / ((double) reps * M * N);
+
+	AbstractFFT<Real>* fft = createFFT<Real> (N);
+	start = std::chrono::steady_clock::now ();
+	for (int r = 0; r < reps; ++r) fft->forward (&a[0]);
+	t = std::chrono::steady_clock::now () - start;
+	conv_model.fft = t.count () / ((double) reps * N * log2 ((double) N));
+	delete fft;
+
+	for (int i = 0; i < 2 * N; ++i) a[i] = ((Real) rand () / RAND_MAX) * 2. - 1;
+	start = std::chrono::steady_clock::now ();
+	for (int r = 0; r < reps; ++r) complexMultiplyReplace (&a[0], &b[0], &c[0], N);
+	t = std::chrono::steady_clock::now () - start;
+	conv_model.mac = t.count () / ((double) reps * N);
+
+	std::valarray<Real> model (3);
+	model[0] = conv_model.direct; model[1] = conv_model.fft; model[2] = conv_model.mac;
+	return Atom::make_array (model);
+}
+AtomPtr fn_blockconv (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& ir = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	std::valarray<Real>& sig = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
+	Real scale = type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	Real mix = 0;
+	if (n->sequence.size () > 3) mix = type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0];
+	int bsize = 1024;
+	if (n->sequence.size () > 4) bsize = (int) type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0];
+	long irsamps = ir.size ();
+	long sigsamps = sig.size ();
+	if (irsamps <= 0 || sigsamps <= 0 || bsize < 2) error ("invalid lengths for blockconv", n);
+	bsize = next_pow2 (bsize);
+	BlockConv<Real> conv (&ir[0], nullptr, irsamps, bsize, scale);
+	long outsamps = irsamps + sigsamps - 1;
+	std::valarray<Real> out (outsamps);
+	std::valarray<Real> in (bsize);
+	std::valarray<Real> block (bsize);
+	for (long p = 0; p < outsamps; p += bsize) {
+		for (long i = 0; i < bsize; ++i) in[i] = p + i < sigsamps ? sig[p + i] : 0;
+		conv.process (&in[0], &block[0]);
+		for (long i = 0; i < bsize && p + i < outsamps; ++i) out[p + i] = block[i] + in[i] * mix;
+	}
+	return Atom::make_array (out);
+}
+AtomPtr fn_partconv (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& ir = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	std::valarray<Real>& sig = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
+	Real scale = type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	Real mix = 0;
+	if (n->sequence.size () > 3) mix = type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0];
+	int bsize = 64;
+	if (n->sequence.size () > 4) bsize = (int) type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0];
+	int maxsize = 8192;
+	if (n->sequence.size () > 5) maxsize = (int) type_check (n->sequence.at (5), AtomType::ARRAY, n)->array[0];
+	long irsamps = ir.size ();
+	long sigsamps = sig.size ();
+	if (irsamps <= 0 || sigsamps <= 0 || bsize < 2 || maxsize < 2) error ("invalid lengths for partconv", n);
+	bsize = next_pow2 (bsize);
+	maxsize = next_pow2 (maxsize);
+	PartConv<Real> conv (&ir[0], irsamps, bsize, maxsize, scale);
+	long outsamps = irsamps + sigsamps - 1;
+	std::valarray<Real> out (outsamps);
+	std::valarray<Real> in (bsize);
+	std::valarray<Real> block (bsize);
+	for (long p = 0; p < outsamps; p += bsize) {
+		for (long i = 0; i < bsize; ++i) in[i] = p + i < sigsamps ? sig[p + i] : 0;
+		conv.process (&in[0], &block[0]);
+		for (long i = 0; i < bsize && p + i < outsamps; ++i) out[p + i] = block[i] + in[i] * mix;
+	}
+	conv_info.strategy = "partitioned";
+	conv_info.sizes.clear ();
+	conv_info.offsets.clear ();
+	for (int k = 0; k < conv.stages (); ++k) {
+		conv_info.sizes.push_back (conv.stageSize (k));
+		conv_info.offsets.push_back (conv.stageOffset (k));
+	}
+	conv_info.blocks = conv.calls ();
+	conv_info.mean_cost = conv.meanCost ();
+	conv_info.max_cost = conv.maxCost ();
+	for (int i = 0; i < 3; ++i) conv_info.estimates[i] = 0;
+	return Atom::make_array (out);
+}
+AtomPtr fn_multiconv (AtomPtr n, AtomPtr env) {
+	AtomPtr irs = type_check (n->sequence.at (0), AtomType::LIST, n);
+	std::valarray<Real>& sig = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array;
+	Real scale = type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	Real mix = 0;
+	if (n->sequence.size () > 3) mix = type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0];
+	int nirs = irs->sequence.size ();
+	long sigsamps = sig.size ();
+	long max = sigsamps;
+	for (int k = 0; k < nirs; ++k) {
+		long irsamps = type_check (irs->sequence.at (k), AtomType::ARRAY, n)->array.size ();
+		if (irsamps <= 0) error ("invalid lengths for multiconv", n);
+		if (irsamps > max) max = irsamps;
+	}
+	if (nirs == 0 || sigsamps <= 0) error ("invalid lengths for multiconv", n);
+	int N = next_pow2 (max) << 1;
+
+	// the input is transformed once
+	std::valarray<Real> fbuffsig (2 * N);
+	for (long i = 0; i < sigsamps; ++i) fbuffsig[2 * i] = sig[i];
+	AbstractFFT<Real>* fft = createFFT<Real> (N);
+	fft->forward (&fbuffsig[0]);
+	delete fft;
+
+	// responses go in pairs through one complex FFT (real and imaginary part),
+	// pairs are spread over the pool and each chunk of pairs owns its FFT
+	std::vector<std::valarray<Real> > outs (nirs);
+	int pairs = (nirs + 1) / 2;
+	ThreadPool& pool = ThreadPool::instance ();
+	int chunks = pairs < pool.size () ? pairs : pool.size ();
+	pool.parallel_for (0, chunks, [&] (int c) {
+		AbstractFFT<Real>* fft = createFFT<Real> (N);
+		std::valarray<Real> fbuff (2 * N);
+		for (int p = pairs * c / chunks; p < pairs * (c + 1) / chunks; ++p) {
+			fbuff = 0;
+			for (int j = 0; j < 2 && 2 * p + j < nirs; ++j) {
+				std::valarray<Real>& ir = irs->sequence.at (2 * p + j)->array;
+				for (unsigned i = 0; i < ir.size (); ++i) fbuff[2 * i + j] = ir[i];
+			}
+			fft->forward (&fbuff[0]);
+			complexMultiplyReplace (&fbuff[0], &fbuffsig[0], &fbuff[0], N);
+			fft->inverse (&fbuff[0]);
+			for (int j = 0; j < 2 && 2 * p + j < nirs; ++j) {
+				long outsamps = irs->sequence.at (2 * p + j)->array.size () + sigsamps - 1;
+				std::valarray<Real>& out = outs[2 * p + j];
+				out.resize (outsamps);
+				for (long i = 0; i < outsamps; ++i) {
+					Real s = scale * fbuff[2 * i + j] / N;
+					if (i < sigsamps) s += sig[i] * mix;
+					out[i] = s;
+				}
+			}
+		}
+		delete fft;
+	});
+	AtomPtr l = Atom::make_sequence ();
+	for (int k = 0; k < nirs; ++k) l->sequence.push_back (Atom::make_array (outs[k]));
+	return l;
+}
+// fdn sig sr t60 [scale] [mix] [t60high] [delays]: stereo reverb by feedback
+// delay network, scale * wet + mix * dry as with conv; t60high (decay above
+// the crossover) defaults to t60 / 2, the delays (samples) to 8 lines of 30-67 ms
+AtomPtr fn_fdn (AtomPtr n, AtomPtr env) {
+	std::valarray<Real>& sig = type_check (n->sequence.at (0), AtomType::ARRAY, n)->array;
+	Real sr = type_check (n->sequence.at (1), AtomType::ARRAY, n)->array[0];
+	Real t60 = type_check (n->sequence.at (2), AtomType::ARRAY, n)->array[0];
+	Real scale = 1, mix = 0, t60high = t60 / 2;
+	if (n->sequence.size () > 3) scale = type_check (n->sequence.at (3), AtomType::ARRAY, n)->array[0];
+	if (n->sequence.size () > 4) mix = type_check (n->sequence.at (4), AtomType::ARRAY, n)->array[0];
+	if (n->sequence.size () > 5) t60high = type_check (n->sequence.at (5), AtomType::ARRAY, n)->array[0];
+	if (sr <= 0 || t60 <= 0 || t60high <= 0) error ("invalid parameters for", n);
+	std::vector<int> delays;
+	if (n->sequence.size () > 6) {
+		std::valarray<Real>& d = type_check (n->sequence.at (6), AtomType::ARRAY, n)->array;
+		for (unsigned k = 0; k < d.size (); ++k) delays.push_back ((int) d[k]);
+	} else {
+		const Real ms[] = {30.7, 37.1, 41.3, 43.9, 47.9, 53.3, 59.9, 67.1};
+		for (int k = 0; k < 8; ++k) delays.push_back ((int) (ms[k] * sr / 1000));
+	}
+	for (unsigned k = 0; k < delays.size (); ++k) {
+		if (delays[k] < 1) error ("invalid delay length in", n);
+	}
+	if (delays.empty ()) error ("no delay lines given in", n);
+	long len = (long) sig.size () + (long) (sr * (t60 > t60high ? t60 : t60high));
+	AtomPtr left = Atom::make_array (0.), right = Atom::make_array (0.);
+	left->array.resize (len, 0);
+	right->array.resize (len, 0);
+	FdnReverb<Real> reverb (sr, delays, t60, t60high);
+	// the input is streamed in blocks, zero after its end
+	const long BLOCK = 4096;
+	std::vector<Real> input (BLOCK);
+	for (long t = 0; t < len; t += BLOCK) {
+		long b = len - t < BLOCK ? len - t : BLOCK;
+		for (long i = 0; i < b; ++i) input[i] = t + i < (long) sig.size () ? sig[t + i] : 0;
+		reverb.process (&input[0], &left->array[t], &right->array[t], b);
+		for (long i = 0; i < b; ++i) {
+			left->array[t + i] = scale * left->array[t + i] + mix * input[i];
+			right->array[t + i] = scale * right->array[t + i] + mix * input[i];
+		}
+	}
+	AtomPtr l = Atom::make_sequence ();
+	l->sequence.push_back (left);
+	l->sequence.push_back (right);
+	return l;
+}
+AtomPtr fn_convinfo (AtomPtr n, AtomPtr env) {
+	AtomPtr l = Atom::make_sequence ();
+	l->sequence.push_back (Atom::make_symbol (conv_info.strategy));
+	std::valarray<Real> sizes (conv_info.sizes.size ());
+	std::valarray<Real> offsets (conv_info.offsets.size ());
+	for (unsigned i = 0; i < conv_info.sizes.size (); ++i) {
+		sizes[i] = conv_info.sizes[i];
+		offsets[i] = conv_info.offsets[i];
+	}
+	l->sequence.push_back (Atom::make_array (sizes));
+	l->sequence.push_back (Atom::make_array (offsets));
+	l->sequence.push_back (Atom::make_array (conv_info.blocks));
+	l->sequence.push_back (Atom::make_array (conv_info.mean_cost * 1e6)); // microseconds
+	l->sequence.push_back (Atom::make_array (conv_info.max_cost * 1e6));
+	std::valarray<Real> estimates (3);
+	for (int i = 0; i < 3; ++i) estimates[i] = conv_info.estimates[i] * 1e6;
+	l->sequence.push_back (Atom::make_array (estimates)); // direct, fft, partitioned
+	std::valarray<Real> model (3);
+	model[0] = conv_model.direct; model[1] = conv_model.fft; model[2] = conv_model.mac;
+	l->sequence.push_back (Atom::make_array (model));
+	return l;
 }
 AtomPtr fn_noise (AtomPtr n, AtomPtr env) {
  	int len = (int) type_check (n->sequence.at (0), AtomType::ARRAY, n)->array[0];
@@ -217,9 +1224,211 @@ AtomPtr fn_noise (AtomPtr n, AtomPtr env) {
 	return Atom::make_array (out);
 }
 // I/O  -----------------------------------------------------------------------
+// graphs: nodes are block processors, rendered by sndwrite
+void delete_graph (void* g) {
+	delete (Graph<Real>*) g;
+}
+// threads = 0 uses all the workers, 1 renders serially
+AtomPtr fn_graph (AtomPtr node, AtomPtr env) {
+	int block = 256;
+	if (node->sequence.size ()) block = (int) type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	int threads = 0;
+	if (node->sequence.size () > 1) threads = (int) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	if (block < 1 || threads < 0) error ("invalid parameters for", node);
+	return Atom::make_object ("graph", new Graph<Real> (block, threads), Atom::make_sequence (), delete_graph);
+}
+Graph<Real>* graph_check (AtomPtr g, AtomPtr node) {
+	type_check (g, AtomType::OBJECT, node);
+	if (g->token != "graph") error ("graph expected in", node);
+	return (Graph<Real>*) g->obj;
+}
+const char* GRAPH_NODES[] = {"osc", "reson", "bpf", "mix", "mul", "const", "conv", "sndread", "curve"};
+// fewest arguments after the type (as for the builtins making the units)
+const unsigned GRAPH_NODE_ARGS[] = {2, 3, 3, 0, 0, 1, 2, 1, 4};
+// the arguments after the type are those of oscil, resonator, envelope,
+// convolver, curvenv; mix takes the gains of its inputs
+AtomPtr fn_node (AtomPtr node, AtomPtr env) {
+	Graph<Real>* g = graph_check (node->sequence.at (0), node);
+	AtomPtr t = node->sequence.at (1);
+	if (t->type != AtomType::SYMBOL && t->type != AtomType::STRING) error ("invalid node type in", node);
+	int type = 0;
+	while (type < 9 && t->token != GRAPH_NODES[type]) ++type;
+	if (type == 9) error ("unknown node type " + t->token + " in", node);
+	AtomPtr args = Atom::make_sequence ();
+	for (unsigned i = 2; i < node->sequence.size (); ++i) args->sequence.push_back (node->sequence.at (i));
+	if (args->sequence.size () < GRAPH_NODE_ARGS[type]) error ("missing arguments for " + t->token + " node in", node);
+	AtomPtr unit = nullptr;
+	GraphBlock<Real>* b = nullptr;
+	switch (type) {
+		case 0: unit = fn_oscil (args, env); break;
+		case 1: unit = fn_resonator (args, env); break;
+		case 2: unit = fn_envelope<2> (args, env); break;
+		case 3: {
+			std::vector<Real> gains;
+			for (unsigned i = 0; i < args->sequence.size (); ++i) {
+				gains.push_back (type_check (args->sequence.at (i), AtomType::ARRAY, node)->array[0]);
+			}
+			b = new MixBlock<Real> (gains);
+		}
+		break;
+		case 4: b = new MulBlock<Real> (); break;
+		case 5: b = new ConstBlock<Real> (type_check (args->sequence.at (0), AtomType::ARRAY, node)->array[0]); break;
+		case 6: unit = fn_convolver (args, env); break;
+		case 7: {
+			std::string file = type_check (args->sequence.at (0), AtomType::STRING, node)->token;
+			int channel = 0;
+			if (args->sequence.size () > 1) channel = (int) type_check (args->sequence.at (1), AtomType::ARRAY, node)->array[0];
+			b = new SndReadBlock<Real> (file.c_str (), channel, g->maxBlock ());
+		}
+		break;
+		case 8: unit = fn_envelope<3> (args, env); break;
+	}
+	if (unit) {
+		// the node takes the unit over
+		unit->deleter = nullptr;
+		b = new UnitBlock<Real> ((Unit<Real>*) unit->obj, g->maxBlock ());
+	}
+	return Atom::make_array (g->add (b));
+}
+// inputs are numbered in the order of connection
+AtomPtr fn_connect (AtomPtr node, AtomPtr env) {
+	Graph<Real>* g = graph_check (node->sequence.at (0), node);
+	int src = (int) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	int dst = (int) type_check (node->sequence.at (2), AtomType::ARRAY, node)->array[0];
+	if (src < 0 || dst < 0 || src >= g->size () || dst >= g->size ()) error ("invalid nodes in", node);
+	g->connect (src, dst);
+	return Atom::make_array (dst);
+}
+// statistics of the last render: threads, blocks, work, mean and max
+// critical path per block (microseconds), parallelism (work / critical path)
+AtomPtr fn_graphinfo (AtomPtr node, AtomPtr env) {
+	Graph<Real>* g = graph_check (node->sequence.at (0), node);
+	AtomPtr l = Atom::make_sequence ();
+	long blocks = g->blocks ();
+	l->sequence.push_back (Atom::make_array (g->threads ()));
+	l->sequence.push_back (Atom::make_array (blocks));
+	l->sequence.push_back (Atom::make_array (blocks ? g->work () / blocks * 1e6 : 0));
+	l->sequence.push_back (Atom::make_array (blocks ? g->criticalPath () / blocks * 1e6 : 0));
+	l->sequence.push_back (Atom::make_array (g->maxCriticalPath () * 1e6));
+	l->sequence.push_back (Atom::make_array (g->criticalPath () > 0 ? g->work () / g->criticalPath () : 1));
+	return l;
+}
+// scores: events rendered block by block, voices made when they start
+void delete_score (void* s) {
+	delete (Score<Real>*) s;
+}
+AtomPtr fn_score (AtomPtr node, AtomPtr env) {
+	int block = 256;
+	if (node->sequence.size ()) block = (int) type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
+	if (block < 1) error ("invalid block size for", node);
+	return Atom::make_object ("score", new Score<Real> (block), Atom::make_sequence (), delete_score);
+}
+Score<Real>* score_check (AtomPtr s, AtomPtr node) {
+	type_check (s, AtomType::OBJECT, node);
+	if (s->token != "score") error ("score expected in", node);
+	return (Score<Real>*) s->obj;
+}
+// the voice is a proc called with the duration and the other arguments when
+// the event starts (returning its samples), or a graph and its output node
+// (restarted by every event, so events on one graph must not overlap)
+AtomPtr fn_event (AtomPtr node, AtomPtr env) {
+	Score<Real>* s = score_check (node->sequence.at (0), node);
+	long start = (long) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	long dur = (long) type_check (node->sequence.at (2), AtomType::ARRAY, node)->array[0];
+	AtomPtr instr = node->sequence.at (3);
+	if (start < 0 || dur < 0) error ("invalid event time in", node);
+	if (instr->type == AtomType::SYMBOL) instr = assoc (instr->token, env);
+	if (instr->type == AtomType::OBJECT) {
+		Graph<Real>* g = graph_check (instr, node);
+		if (node->sequence.size () < 5) error ("output node needed for graph in", node);
+		int out = (int) type_check (node->sequence.at (4), AtomType::ARRAY, node)->array[0];
+		if (out < 0 || out >= g->size ()) error ("invalid output node in", node);
+		if (s->overlaps (start, dur, g)) error ("graph already playing at the time of", node);
+		// the maker keeps the graph alive
+		s->add (start, dur, [instr, g, out] () { return new GraphVoice<Real> (g, out); }, g);
+	} else if (instr->type == AtomType::PROC || instr->type == AtomType::BUILTIN) {
+		AtomPtr call = Atom::make_sequence ();
+		call->sequence.push_back (instr);
+		call->sequence.push_back (Atom::make_array ((Real) dur));
+		for (unsigned i = 4; i < node->sequence.size (); ++i) call->sequence.push_back (node->sequence.at (i));
+		s->add (start, dur, [call, env, node] () {
+			AtomPtr r = type_check (eval (call, env), AtomType::ARRAY, node);
+			std::valarray<Real>& v = r->array;
+			return new ArrayVoice<Real> (v.size () ? &v[0] : nullptr, v.size ());
+		});
+	} else error ("proc or graph expected in", node);
+	return Atom::make_array (s->events ());
+}
+// the whole score (or its first len samples) as an array
+AtomPtr fn_render (AtomPtr node, AtomPtr env) {
+	Score<Real>* s = score_check (node->sequence.at (0), node);
+	long len = s->length ();
+	if (node->sequence.size () > 1) len = (long) type_check (node->sequence.at (1), AtomType::ARRAY, node)->array[0];
+	if (len < 0) error ("invalid length in", node);
+	std::valarray<Real> out (len);
+	s->rewind ();
+	for (long t = 0; t < len; t += s->maxBlock ()) {
+		s->process (&out[t], (int) (len - t < s->maxBlock () ? len - t : s->maxBlock ()));
+	}
+	return Atom::make_array (out);
+}
+// events, length and most voices sounding together in the last render
+AtomPtr fn_scoreinfo (AtomPtr node, AtomPtr env) {
+	Score<Real>* s = score_check (node->sequence.at (0), node);
+	AtomPtr l = Atom::make_sequence ();
+	l->sequence.push_back (Atom::make_array (s->events ()));
+	l->sequence.push_back (Atom::make_array (s->length ()));
+	l->sequence.push_back (Atom::make_array (s->peakVoices ()));
+	return l;
+}
+// streams a score (or its first len samples) to a mono file
+AtomPtr score_write (Real sr, const std::string& file, Score<Real>* s, AtomPtr node) {
+	long len = s->length ();
+	if (node->sequence.size () > 3) len = (long) type_check (node->sequence.at (3), AtomType::ARRAY, node)->array[0];
+	if (len < 0) error ("invalid length in", node);
+	int block = s->maxBlock ();
+	WavOutFile outf (file.c_str (), sr, 16, 1);
+	std::vector<Real> buffer (block);
+	s->rewind ();
+	for (long t = 0; t < len; t += block) {
+		int n = (int) (len - t < block ? len - t : block);
+		s->process (&buffer[0], n);
+		outf.write (&buffer[0], n);
+	}
+	return Atom::make_array (len);
+}
+// streams len samples of the output nodes (one per channel) to a file
+AtomPtr graph_write (Real sr, const std::string& file, Graph<Real>* g, AtomPtr node) {
+	long len = (long) type_check (node->sequence.at (3), AtomType::ARRAY, node)->array[0];
+	std::valarray<Real>& outs = type_check (node->sequence.at (4), AtomType::ARRAY, node)->array;
+	std::vector<int> outputs;
+	for (unsigned i = 0; i < outs.size (); ++i) outputs.push_back ((int) outs[i]);
+	if (outputs.empty () || len < 0) error ("invalid outputs for", node);
+	g->prepare (outputs);
+	int channels = outputs.size ();
+	int block = g->maxBlock ();
+	WavOutFile outf (file.c_str (), sr, 16, channels);
+	std::vector<Real> frames (block * channels);
+	for (long t = 0; t < len; t += block) {
+		int n = (int) (len - t < block ? len - t : block);
+		g->process (n);
+		for (int c = 0; c < channels; ++c) {
+			const Real* y = g->output (outputs[c]);
+			for (int i = 0; i < n; ++i) frames[i * channels + c] = y[i];
+		}
+		outf.write (&frames[0], n * channels);
+	}
+	return Atom::make_array (len * channels);
+}
 AtomPtr fn_sndwrite (AtomPtr node, AtomPtr env) {
 	Real sr = type_check (node->sequence.at (0), AtomType::ARRAY, node)->array[0];
 	std::valarray<Real> vals;
+	if (node->sequence.at (2)->type == AtomType::OBJECT) {
+		std::string file = type_check (node->sequence.at (1), AtomType::STRING, node)->token;
+		if (node->sequence.at (2)->token == "score") return score_write (sr, file, (Score<Real>*) node->sequence.at (2)->obj, node);
+		if (node->sequence.size () < 5) error ("length and outputs needed to write a graph in", node);
+		return graph_write (sr, file, graph_check (node->sequence.at (2), node), node);
+	}
 	if (node->sequence.size () == 3) {
 		WavOutFile outf (type_check (node->sequence.at (1), AtomType::STRING, node)->token.c_str(), sr, 16, 1);
 		vals = type_check (node->sequence.at (2), AtomType::ARRAY, node)->array;
@@ -259,17 +1468,52 @@ AtomPtr fn_sndread (AtomPtr node, AtomPtr env) {
 }
 void add_numeric (AtomPtr env) {
 	add_builtin ("bpf", fn_bpf, 3, env);
-	add_builtin ("mix", fn_mix, 2, env);	
+	add_builtin ("curve", fn_curve, 4, env);
+	add_builtin ("mix", fn_mix, 1, env);
 	add_builtin ("gen", fn_gen, 2, env);
+	add_builtin ("wavetable", fn_wavetable, 1, env);
 	add_builtin ("osc", fn_osc, 3, env);
+	add_builtin ("oscbank", fn_oscbank, 4, env);
+	add_builtin ("addsyn", fn_addsyn, 3, env);
 	add_builtin ("reson", fn_reson, 3, env);
+	add_builtin ("filterbank", fn_filterbank, 4, env);
+	add_builtin ("grains", fn_grains, 4, env);
+	add_builtin ("oscil", fn_oscil, 2, env);
+	add_builtin ("resonator", fn_resonator, 3, env);
+	add_builtin ("envelope", fn_envelope<2>, 3, env);
+	add_builtin ("curvenv", fn_envelope<3>, 4, env);
+	add_builtin ("convolver", fn_convolver, 2, env);
+	add_builtin ("process", fn_process, 2, env);
 	add_builtin ("fft", fn_fft<1>, 1, env);
 	add_builtin ("ifft", fn_fft<-1>, 1, env);
 	add_builtin ("car2pol", fn_car2pol, 1, env);
 	add_builtin ("pol2car", fn_pol2car, 1, env);
+	add_builtin ("stft", fn_stft, 3, env);
+	add_builtin ("istft", fn_istft, 3, env);
+	add_builtin ("pvoc", fn_pvoc, 3, env);
+	add_builtin ("partials", fn_partials, 2, env);
+	add_builtin ("features", fn_features, 2, env);
+	add_builtin ("pitch", fn_pitch, 2, env);
+	add_builtin ("onsets", fn_onsets, 1, env);
+	add_builtin ("xcorr", fn_xcorr, 2, env);
+	add_builtin ("autocorr", fn_autocorr, 1, env);
 	add_builtin ("conv", fn_conv, 3, env);
+	add_builtin ("blockconv", fn_blockconv, 3, env);
+	add_builtin ("partconv", fn_partconv, 3, env);
+	add_builtin ("multiconv", fn_multiconv, 3, env);
+	add_builtin ("fdn", fn_fdn, 3, env);
+	add_builtin ("convinfo", fn_convinfo, 0, env);
+	add_builtin ("convcalibrate", fn_convcalibrate, 0, env);
 	add_builtin ("noise", fn_noise, 1, env);
 	// // I/O
+	add_builtin ("graph", fn_graph, 0, env);
+	add_builtin ("node", fn_node, 2, env);
+	add_builtin ("connect", fn_connect, 3, env);
+	add_builtin ("graphinfo", fn_graphinfo, 1, env);
+	add_builtin ("score", fn_score, 0, env);
+	add_builtin ("event", fn_event, 4, env);
+	add_builtin ("render", fn_render, 1, env);
+	add_builtin ("scoreinfo", fn_scoreinfo, 1, env);
 	add_builtin ("sndwrite", fn_sndwrite, 3, env);
 	add_builtin ("sndread", fn_sndread, 1, env);
 }
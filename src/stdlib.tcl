@@ -129,20 +129,6 @@ proc interleave {in1 in2} {
     array $out
 }
 
-proc oscbank {sr amps freqs tab} {
-	set elems [llength $amps] # assumes both freqs and amps have the same number of elems
-	if {!= $elems 0} {
-		set outbuff [bpf 0 [size [car $freqs]] 0]
-		set i 0
-		while {< $i $elems} {
-			assign $outbuff [+ $outbuff [* [car $amps] [osc $sr [car $freqs] $tab]]] 0 [size $outbuff]
-			set amps [cdr $amps]
-			set freqs [cdr $freqs]
-			set i [+ $i 1]
-		}
-		array $outbuff
-	}
-}
 
 
 # eof
@@ -0,0 +1,62 @@
+// fft_bench.cpp
+//
+// compares the FFT engines available through createFFT (time per forward transform)
+// build with -DENABLE_BENCHMARKS=ON
+//
+
+#include "FFT.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+double seconds_per_transform (AbstractFFT<double>* fft, vector<double>& data, int runs) {
+	auto start = chrono::steady_clock::now ();
+	for (int r = 0; r < runs; ++r) fft->forward (&data[0]);
+	chrono::duration<double> elapsed = chrono::steady_clock::now () - start;
+	return elapsed.count () / runs;
+}
+
+int main (int argc, char* argv[]) {
+	int minp = argc > 1 ? atoi (argv[1]) : 12;
+	int maxp = argc > 2 ? atoi (argv[2]) : 24;
+	printf ("threads: %d\n\n", ThreadPool::instance ().size ());
+	printf ("%10s %14s %14s %14s %12s\n", "size", "template (ms)", "simd (ms)", "fourstep (ms)", "max error");
+	for (int p = minp; p <= maxp; ++p) {
+		int N = 1 << p;
+		int runs = (1 << 24) / N;
+		if (runs > 64) runs = 64;
+		if (runs < 2) runs = 2;
+
+		vector<double> input (2 * (size_t) N);
+		for (size_t i = 0; i < input.size (); ++i) input[i] = (double) rand () / RAND_MAX * 2. - 1;
+
+		AbstractFFT<double>* ref = createFFT<double> (N, FFT_TEMPLATE);
+		AbstractFFT<double>* simd = createFFT<double> (N, FFT_SIMD);
+		AbstractFFT<double>* large = createFFT<double> (N, FFT_FOURSTEP);
+
+		vector<double> a (input), b (input), c (input);
+		ref->forward (&a[0]);
+		simd->forward (&b[0]);
+		large->forward (&c[0]);
+		double err = 0;
+		for (size_t i = 0; i < a.size (); ++i) {
+			double d = fabs (a[i] - b[i]) > fabs (a[i] - c[i]) ? fabs (a[i] - b[i]) : fabs (a[i] - c[i]);
+			if (d > err) err = d;
+		}
+
+		double tref = seconds_per_transform (ref, a, runs);
+		double tsimd = seconds_per_transform (simd, b, runs);
+		double tlarge = seconds_per_transform (large, c, runs);
+		printf ("%10d %14.3f %14.3f %14.3f %12.3g\n", N, tref * 1e3, tsimd * 1e3, tlarge * 1e3, err);
+		delete ref;
+		delete simd;
+		delete large;
+	}
+	return 0;
+}
+
+// EOF
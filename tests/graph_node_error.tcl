@@ -0,0 +1,3 @@
+# a node without its arguments is rejected (run by ctest)
+set g [graph 32]
+node $g const
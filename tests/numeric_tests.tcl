@@ -0,0 +1,318 @@
+# {Tests for the Quile numeric library}
+#
+# (c) 2020, www.quile.org
+#
+source "stdlib.tcl"
+
+proc close {x y} {< [max [abs [- $x $y]]] 0.000001}
+
+puts $nl "--- convolution ---" $nl
+set ir [noise 3000]
+set sig [noise 20000]
+set ref [conv $ir $sig 0.5 0.3]
+test {size [blockconv $ir $sig 0.5 0.3]}{22999}
+test {close $ref [blockconv $ir $sig 0.5 0.3]}{1}
+test {close $ref [blockconv $ir $sig 0.5 0.3 256]}{1}
+test {close $ref [blockconv $ir $sig 0.5 0.3 4096]}{1}
+test {close $ref [partconv $ir $sig 0.5 0.3]}{1}
+test {close $ref [partconv $ir $sig 0.5 0.3 32 256]}{1}
+test {car [convinfo]}{partitioned}
+set h [noise 16]
+test {close [conv $h $sig 0.5 0.3] [blockconv $h $sig 0.5 0.3 64]}{1}
+test {car [convinfo]}{direct}
+test {close [conv $sig $sig 0.5] [blockconv $sig $sig 0.5 0 4096]}{1}
+test {size [convcalibrate]}{3}
+set ir2 [noise 5000]
+set outs [multiconv [list $ir $ir2 $ir] $sig 0.5 0.3]
+test {llength $outs}{3}
+test {close $ref [car $outs]}{1}
+test {close [conv $ir2 $sig 0.5 0.3] [second $outs]}{1}
+test {close $ref [llast $outs]}{1}
+
+puts $nl "--- stft ---" $nl
+set sig [noise 10000]
+set spec [stft $sig 1024 256]
+test {size $spec}{41040}
+test {close $sig [slice [istft $spec 1024 256] 0 10000]}{1}
+test {close $sig [istft [stft $sig 512 128 [bpf 1 512 1]] 512 128 [bpf 1 512 1] 10000]}{1}
+
+puts $nl "--- pvoc ---" $nl
+set sig [osc 44100 [bpf 440 44100 440] [gen 4096 [array 1]]]
+set id [pvoc $sig [array 1] [array 1]]
+test {size $id}{44544}
+test {close [slice $id 1000 40000] [slice $sig 1000 40000]}{1}
+test {size [pvoc $sig [array 2] [array 1]]}{88576}
+test {size [pvoc $sig [array 1] [array 1.5] 1024 8]}{44160}
+
+puts $nl "--- partials ---" $nl
+set tab [gen 4096 [array 1]]
+set sig [+ [* [bpf 0.5 44100 0.5] [osc 44100 [bpf 440 44100 440] $tab]] [* [bpf 0.25 44100 0.25] [osc 44100 [bpf 1000 44100 1200] $tab]]]
+set p [partials $sig 44100]
+test {llength $p}{2}
+test {car [car $p]}{0}
+test {< [abs [- [slice [llast [car $p]] 40 1] 440]] 1}{1}
+test {< [abs [- [slice [second [car $p]] 40 1] 0.5]] 0.03}{1}
+
+puts $nl "--- features ---" $nl
+set sig [* [bpf 0.5 44100 0.5] [osc 44100 [bpf 1000 44100 1000] $tab]]
+set f [features $sig 44100 {rms centroid zcr}]
+test {size $f}{261}
+test {< [abs [- [slice $f 60 1] 0.3535]] 0.001}{1}
+test {< [abs [- [slice $f 61 1] 1000]] 50}{1}
+test {size [features $sig 44100]}{1740}
+test {size [features $sig 44100 mfcc 1024 256]}{2249}
+
+puts $nl "--- pitch ---" $nl
+set sig [osc 44100 [bpf 330 44100 330] [gen 4096 [array 1 0.5 0.3]]]
+set p [pitch $sig 44100]
+test {size [car $p]}{87}
+test {< [max [abs [- [slice [car $p] 2 80] [bpf 330 80 330]]]] 0.5}{1}
+test {> [min [slice [second $p] 2 80]] 0.95}{1}
+set q [pitch [list $sig [slice $sig 0 22050]] 44100 100 800 256]
+test {llength $q}{2}
+test {size [car [second $q]]}{87}
+
+puts $nl "--- onsets ---" $nl
+set burst [* [noise 4410] [bpf 1 4410 0]]
+set sig [mix 0 [bpf 0 88200 0] 11025 $burst 33075 $burst 55125 $burst 66150 $burst]
+set times [array 0.25 0.75 1.25 1.5]
+test {size [onsets $sig]}{4}
+test {< [max [abs [- [onsets $sig] $times]]] 0.03}{1}
+test {< [max [abs [- [onsets $sig complex] $times]]] 0.03}{1}
+test {< [max [abs [- [onsets $sig hfc] $times]]] 0.03}{1}
+sndwrite 44100 "onsets_test.wav" $sig
+test {< [max [abs [- [onsets "onsets_test.wav"] $times]]] 0.03}{1}
+exec "rm onsets_test.wav"
+
+puts $nl "--- correlation ---" $nl
+test {close [xcorr [array 1 2 3] [array 0 1 0.5]] [array 0.5 2 3.5 3 0]}{1}
+test {close [xcorr [array 1 2 3] [array 0 1 0.5] 1] [array 2 3.5 3]}{1}
+test {close [autocorr [array 1 2 3]] [array 14 8 3]}{1}
+set a [noise 100000]
+set b [mix 1234 $a]
+test {second [xcorr $b $a 2000 1]}{1234}
+test {second [xcorr $a $b 2000 1]}{-1234}
+test {second [autocorr [osc 44100 [bpf 441 4410 441] [gen 4096 [array 1 0.5]]] 1000 1]}{100}
+
+puts $nl "--- curve ---" $nl
+test {close [curve 0 100 1 0 50 0.5 0] [bpf 0 100 1 50 0.5]}{1}
+set c [curve 1 1000 0 -4]
+test {size $c}{1000}
+test {slice $c 0 1}{1}
+test {close [slice $c 500 1] [- 1 [/ [- 1 [exp -2]] [- 1 [exp -4]]]]}{1}
+test {< [slice $c 500 1] [slice [bpf 1 1000 0] 500 1]}{1}
+set c [curve 0 300 1 3 200 0.25 -2 100 0.25 0]
+set e [curvenv 0 300 1 3 200 0.25 -2 100 0.25 0]
+set seg [array [process $e 7] [process $e 293] [process $e 256] [process $e 44]]
+test {close $seg $c}{1}
+test {close [process $e 10] [bpf 0.25 10 0.25]}{1}
+set e [envelope 0 300 1 200 0.5]
+test {close [array [process $e 123] [process $e 377]] [bpf 0 300 1 200 0.5]}{1}
+
+puts $nl "--- mix ---" $nl
+test {close [mix 2 [array 1 2] 0 [array 1 1 1]] [array 1 1 2 2]}{1}
+test {close [mix [list 0 [array 1 2] 2] [list 1 [array 1]]] [array 2 5]}{1}
+set m [mix [list 0 [array 1 2] 1 0] [list 1 [array 1] 2 1]]
+test {close [car $m] [array 1 2]}{1}
+test {close [second $m] [array 0 2]}{1}
+set m [mix [list 0 $a 1 0.5]]
+test {close [car $m] [second $m]}{1}
+test {< [max [abs [- [car $m] [* $a [bpf 0.707107 100000 0.707107]]]]] 0.000001}{1}
+set m [mix 4 [list 0 $a 1 2.5] [list 10 $a 1 0]]
+test {llength $m}{4}
+test {max [abs [lindex $m 1]]}{0}
+test {close [lindex $m 2] [lindex $m 3]}{1}
+test {close [lindex $m 0] [array [bpf 0 10 0] $a]}{1}
+set m [mix 0 $a 70000 $a]
+test {size $m}{170000}
+test {close $m [+ [array $a [bpf 0 70000 0]] [array [bpf 0 70000 0] $a]]}{1}
+
+puts $nl "--- oscbank ---" $nl
+set tab [gen 4096 [array 1 0.5 0.25]]
+set n 20000
+set amps [list [bpf 0 $n 0.3] [bpf 0.2 $n 0.1] [bpf 0.1 $n 0.1] [bpf 0.5 $n 0] [bpf 0.1 $n 0.4] [bpf 0.3 $n 0.3]]
+set freqs [list [bpf 220 $n 550] [bpf 110 $n 220] [bpf 440 $n 220] [bpf 1000 $n 20] [bpf 30 $n 3000] [bpf 5000 $n 6000]]
+set ref [bpf 0 $n 0]
+set i 0
+while {< $i 6} {
+	set ref [+ $ref [* [lindex $amps $i] [osc 44100 [lindex $freqs $i] $tab]]]
+	set i [+ $i 1]
+}
+test {close $ref [oscbank 44100 $amps $freqs $tab]}{1}
+set ref [+ [* [car $amps] [osc 44100 [car $freqs] $tab]] [* [second $amps] [osc 44100 [second $freqs] $tab]]]
+test {close $ref [oscbank 44100 [array [car $amps] [second $amps]] [array [car $freqs] [second $freqs]] $tab 2]}{1}
+
+puts $nl "--- addsyn ---" $nl
+set tab [gen 4096 [array 1]]
+set amps [list [bpf 0.5 $n 0.5] [bpf 0 $n 0.3] [bpf 0.1 $n 0.1]]
+set freqs [list [bpf 440 $n 440] [bpf 1000 $n 1100] [bpf 3000 $n 3000]]
+set out [addsyn 44100 [list [list 0 [car $amps] [car $freqs]] [list 0 [second $amps] [second $freqs]] [list 0 [lindex $amps 2] [lindex $freqs 2]]] 1]
+test {size $out}{20000}
+test {< [max [abs [- $out [oscbank 44100 $amps $freqs $tab]]]] 0.003}{1}
+set out [addsyn 44100 [list [list 10 [array 0.5 0.5 0.5] [array 440 440 440]]] 100]
+test {size $out}{1201}
+test {< [max [abs [- [slice $out 1000 201] [slice [* [bpf 0.5 1201 0.5] [osc 44100 [bpf 440 1201 440] $tab]] 0 201]]]] 0.003}{1}
+
+puts $nl "--- wavetable ---" $nl
+set w [wavetable [array 1 1]]
+test {eq [wavetable [array 1 1]] $w}{1}
+test {eq [wavetable [array 1 1] 1024] $w}{0}
+set n 4410
+test {close [osc 44100 [bpf 15000 $n 15000] $w] [* [bpf 0.5 $n 0.5] [osc 44100 [bpf 15000 $n 15000] [wavetable [array 1]]]]}{1}
+test {< [max [abs [- [osc 44100 [bpf 440 $n 440] [wavetable [array 1]]] [addsyn 44100 [list [list 0 [bpf 1 $n 1] [bpf 440 $n 440]]] 1]]]] 0.0001}{1}
+
+puts $nl "--- units ---" $nl
+set tab [gen 1024 [array 1 0.5]]
+set f [bpf 100 8000 1000]
+set o [oscil 44100 $tab]
+set a [process $o [slice $f 0 3000]]
+test {close [array $a [process $o [slice $f 3000 5000]]] [osc 44100 $f $tab]}{1}
+set sig [noise 4410]
+set r [resonator 44100 1000 0.1]
+set a [process $r [slice $sig 0 1000]]
+test {close [array $a [process $r [slice $sig 1000 3410]]] [reson $sig 44100 1000 0.1]}{1}
+set e [envelope 0 100 1 50 0]
+set a [process $e 70]
+test {close [array $a [process $e 80]] [bpf 0 100 1 50 0]}{1}
+test {size [process $e 2]}{2}
+test {max [abs [process $e 2]]}{0}
+set ir [noise 3000]
+set c [convolver $ir 1 0 64 1024]
+set a [process $c [slice $sig 0 1000]]
+set wet [partconv $ir $sig 1]
+test {close [slice $a 64 936] [slice $wet 0 936]}{1}
+test {close [process $c [slice $sig 1000 3410]] [slice $wet 936 3410]}{1}
+
+puts $nl "--- grains ---" $nl
+set src [osc 44100 [bpf 440 44100 440] $tab]
+test {size [grains $src [array 100 1000] [array 0 500] [array 2000 1000]]}{2100}
+set a [grains $src [array 0] [array 0] [array 1000]]
+test {close [slice $a 500 1] [slice $src 500 1]}{1}
+test {< [max [abs [- [slice $a 490 20] [slice $src 490 20]]]] 0.001}{1}
+test {< [max [abs [slice $a 0 1]]] 0.000001}{1}
+set b [grains $src [array 0 0] [array 0 0] [array 1000 1000] [array 1] [array 0.5]]
+test {close $a $b}{1}
+set sig [grains $src [array 0 300] [array 0 0] [array 1000 1000] [array 1] [array 1] [array 0 1]]
+test {size [car $sig]}{1300}
+test {close [slice [car $sig] 0 300] [slice $a 0 300]}{1}
+test {< [max [abs [slice [second $sig] 0 300]]] 0.000001}{1}
+set wet [grains $src [array 0] [array 0] [array 1000] [array 1] [array 1] [array 0.5]]
+test {close [car $wet] [* $a [bpf 0.707107 1000 0.707107]]}{1}
+test {close [car $wet] [second $wet]}{1}
+set a [grains $src [array 0] [array 100] [array 1000] [array 0.5]]
+test {close [slice $a 500 1] [slice $src 350 1]}{1}
+
+puts $nl "--- graph ---" $nl
+set n 20000
+set g [graph 256]
+set f [node $g bpf 200 $n 800]
+set o [node $g osc 44100 $tab]
+connect $g $f $o
+set e [node $g bpf 0 10000 0.5 10000 0]
+set m [node $g mul]
+connect $g $o $m
+connect $g $e $m
+set r [node $g reson 44100 1000 0.05]
+connect $g $m $r
+set out [node $g mix 0.7 0.01]
+connect $g $m $out
+connect $g $r $out
+test {sndwrite 44100 "graph_test.wav" $g $n [array $out]}{20000}
+set a [* [osc 44100 [bpf 200 $n 800] $tab] [bpf 0 10000 0.5 10000 0]]
+set a [+ [* [bpf 0.7 $n 0.7] $a] [* [bpf 0.01 $n 0.01] [process [resonator 44100 1000 0.05] $a]]]
+set b [second [sndread "graph_test.wav"]]
+test {< [max [abs [- $a $b]]] 0.0001}{1}
+set g [graph 100]
+set s [node $g sndread "graph_test.wav"]
+set c [node $g conv [array 0.5 0 0 0.25] 1 0 16 16]
+connect $g $s $c
+test {sndwrite 44100 "graph_test2.wav" $g [+ $n 16] [array $c]}{20016}
+set a [+ [array [bpf 0 16 0] [* [bpf 0.5 $n 0.5] $b]] [array [bpf 0 19 0] [* [bpf 0.25 [- $n 3] 0.25] [slice $b 0 [- $n 3]]]]]
+test {< [max [abs [- $a [second [sndread "graph_test2.wav"]]]]] 0.0001}{1}
+proc voices {threads} {
+	set g [graph 128 $threads]
+	set out [node $g mix]
+	set i 0
+	while {< $i 8} {
+		set f [node $g bpf [+ 100 [* $i 10]] 20000 [+ 200 [* $i 10]]]
+		set o [node $g osc 44100 [wavetable [array 1 0.5]]]
+		connect $g $f $o
+		set r [node $g reson 44100 [+ 500 [* $i 50]] 0.05]
+		connect $g $o $r
+		connect $g $r $out
+		set i [+ $i 1]
+	}
+	sndwrite 44100 "graph_test.wav" $g 20000 [array $out]
+	graphinfo $g
+}
+set info [voices 4]
+test {car $info}{4}
+test {second $info}{157}
+test {> [lindex $info 5] 1}{1}
+set a [second [sndread "graph_test.wav"]]
+voices 1
+test {close $a [second [sndread "graph_test.wav"]]}{1}
+exec "rm graph_test.wav graph_test2.wav"
+
+puts $nl "--- fdn ---" $nl
+proc rms {s} {sqrt [/ [sum [* $s $s]] [size $s]]}
+set imp [array [array 1] [bpf 0 44099 0]]
+set r [fdn $imp 44100 2 1 0 2]
+test {llength $r}{2}
+test {size [second $r]}{132300}
+test {max [abs [slice [car $r] 0 1353]]}{0}
+test {> [abs [slice [car $r] 1353 1]] 0.01}{1}
+set a [/ [rms [slice [car $r] 22050 22050]] [rms [slice [car $r] 66150 22050]]]
+test {and [> $a 28] [< $a 36]}{1}
+set r [fdn $imp 44100 2 1 0 2 [array 1000 1300 1700 2100 2300 2900]]
+set a [/ [rms [slice [second $r] 22050 22050]] [rms [slice [second $r] 66150 22050]]]
+test {and [> $a 28] [< $a 36]}{1}
+set r [fdn $imp 44100 2 1 0 0.5]
+set a [/ [rms [slice [car $r] 22050 22050]] [rms [slice [car $r] 66150 22050]]]
+test {> $a 40}{1}
+set sig [noise 1000]
+test {close [car [fdn $sig 44100 0.1 0 0.5]] [* [bpf 0.5 5410 0.5] [array $sig [bpf 0 4410 0]]]}{1}
+
+puts $nl "--- filterbank ---" $nl
+set sig [noise 1000]
+set f [filterbank $sig 44100 [array 1000] [array 0.05]]
+test {size $f}{3205}
+test {close [slice $f 0 2205] [reson $sig 44100 1000 0.05]}{1}
+set f [filterbank $sig 44100 [array 1000 2000 3000 500 700] [array 0.05] [array 1 0.5 0.2 0.1 1] 2205]
+set a [+ [reson $sig 44100 1000 0.05] [* [bpf 0.5 2205 0.5] [reson $sig 44100 2000 0.05]]]
+set a [+ $a [+ [* [bpf 0.2 2205 0.2] [reson $sig 44100 3000 0.05]] [* [bpf 0.1 2205 0.1] [reson $sig 44100 500 0.05]]]]
+test {close $f [+ $a [reson $sig 44100 700 0.05]]}{1}
+set f [filterbank $sig 44100 [list [bpf 1000 3000 1000] [array 2000]] [list [array 0.05]]]
+test {close $f [filterbank $sig 44100 [array 1000 2000] [array 0.05]]}{1}
+set f [filterbank $sig 44100 [list [bpf 1000 1000 1000 1 2000 1 2000]] [array 0.05] [array 1] 2000]
+test {close [slice $f 0 1000] [slice [reson $sig 44100 1000 0.05] 0 1000]}{1}
+test {close [slice $f 1024 976] [slice [reson $sig 44100 1000 0.05] 1024 976]}{0}
+
+puts $nl "--- score ---" $nl
+proc tone {dur freq amp} {* [osc 44100 [bpf $freq $dur $freq] $tab] [bpf $amp $dur $amp]}
+set sc [score 64]
+test {event $sc 1000 500 tone 440 0.5}{1}
+event $sc 10 300 tone 220 0.25
+event $sc 100 2000 $tone 330 0.1
+set a [render $sc]
+test {size $a}{2100}
+test {scoreinfo $sc}{3 2100 2}
+test {close $a [mix 1000 [tone 500 440 0.5] 10 [tone 300 220 0.25] 100 [tone 2000 330 0.1]]}{1}
+test {close [render $sc 1500] [slice $a 0 1500]}{1}
+set g [graph 32]
+set o [node $g osc 44100 $tab]
+connect $g [node $g const 440] $o
+event $sc 50 100 $g $o
+set b [render $sc]
+test {close [slice $b 50 100] [+ [slice $a 50 100] [osc 44100 [bpf 440 100 440] $tab]]}{1}
+test {close [slice $b 150 1950] [slice $a 150 1950]}{1}
+test {sndwrite 44100 "score_test.wav" $sc}{2100}
+test {< [max [abs [- $b [second [sndread "score_test.wav"]]]]] 0.0001}{1}
+exec "rm score_test.wav"
+test {close [render $sc] $b}{1}
+event $sc 150 100 $g $o
+test {close [slice [render $sc] 150 100] [+ [slice $a 150 100] [osc 44100 [bpf 440 100 440] $tab]]}{1}
+
+puts $nl "ALL TESTS PASSED" $nl $nl
+
+# eof
@@ -0,0 +1,2 @@
+# a hop larger than the frame is rejected (run by ctest)
+onsets [noise 5000] flux 1 0.5 64 128
@@ -0,0 +1,44 @@
+// pvoc_bench.cpp
+//
+// throughput of the phase vocoder as real-time factor (seconds of input
+// processed per second of computation) for a few frame sizes and factors
+// build with -DENABLE_BENCHMARKS=ON
+//
+
+#include "PhaseVocoder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+int main (int argc, char* argv[]) {
+	const double sr = 44100;
+	double seconds = argc > 1 ? atof (argv[1]) : 10;
+	long len = (long) (sr * seconds);
+	vector<double> input (len);
+	for (long i = 0; i < len; ++i) {
+		input[i] = .5 * sin (TWOPI * 440. * i / sr) + .25 * sin (TWOPI * 1234. * i / sr)
+			+ .1 * ((double) rand () / RAND_MAX * 2. - 1);
+	}
+	printf ("threads: %d, input: %.1f s\n\n", ThreadPool::instance ().size (), seconds);
+	printf ("%8s %8s %10s %10s %12s %12s\n", "size", "overlap", "stretch", "transp", "time (s)", "x real-time");
+	int sizes[] = {1024, 2048, 4096};
+	double factors[][2] = {{1, 1}, {2, 1}, {.5, 1}, {1, 1.5}};
+	for (int s = 0; s < 3; ++s) {
+		for (int f = 0; f < 4; ++f) {
+			PhaseVocoder<double> pv (sizes[s], 4);
+			vector<double> out;
+			auto start = chrono::steady_clock::now ();
+			pv.process (&input[0], len, &factors[f][0], 1, &factors[f][1], 1, out);
+			chrono::duration<double> elapsed = chrono::steady_clock::now () - start;
+			printf ("%8d %8d %10.2f %10.2f %12.3f %12.1f\n", sizes[s], 4, factors[f][0], factors[f][1],
+				elapsed.count (), seconds / elapsed.count ());
+		}
+	}
+	return 0;
+}
+
+// EOF
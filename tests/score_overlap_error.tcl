@@ -0,0 +1,6 @@
+# events overlapping on the same graph are rejected (run by ctest)
+set g [graph 32]
+set o [node $g const 1]
+set sc [score 64]
+event $sc 0 100 $g $o
+event $sc 50 100 $g $o